@@ -0,0 +1,240 @@
+// microbenchmarks for the intersection and shading kernels, built and run with make bench. every
+// benchmark runs over a fixed set of inputs made from a fixed seed, so runs can be compared against
+// each other to check whether a change to one of the kernels actually pays off
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <unistd.h>
+
+#include "core/TxtReader.h"
+
+using namespace std;
+
+static const int NUM_RAYS = 1 << 16;
+static const int NUM_MESH_RAYS = 1 << 12;   // a mesh takes far longer per ray than a single shape
+static const int NUM_SHAPES = 64;
+static const double MIN_SECONDS = 0.25;    // each benchmark repeats its inputs for at least this long
+
+// passes over the inputs until MIN_SECONDS have gone by, then prints the fastest pass. func takes an
+// input index and returns something to add to the sink, so the calls can't be optimized out
+template <typename F>
+static void RunBenchmark(const string& name, int count, F func, double& sink)
+{
+    double best = INFINITY;
+    double total = 0;
+    int passes = 0;
+    while (total < MIN_SECONDS || passes < 3)
+    {
+        double sum = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < count; i++)
+        {
+            sum += func(i);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        sink += sum;
+        best = min(best, seconds);
+        total += seconds;
+        passes++;
+    }
+
+    double ns = best * 1e9 / count;
+    cout << "  " << left << setw(36) << name << right << fixed << setprecision(2) << setw(12) << ns << " ns/op"
+         << setprecision(4) << setw(12) << 1e3 / ns << " Mops/s" << defaultfloat << endl;
+}
+
+// rays from points around the box towards points inside it, so most of them hit something
+static vector<Ray> MakeRays(Vector3 boxMin, Vector3 boxMax, int count, unsigned int seed)
+{
+    mt19937 rng(seed);
+    uniform_real_distribution<Float> unit(0, 1);
+    Vector3 center = (boxMin + boxMax) * 0.5;
+    Float radius = (boxMax - boxMin).magnitude();
+
+    vector<Ray> rays(count);
+    for (int i = 0; i < count; i++)
+    {
+        Float z = unit(rng) * 2 - 1;
+        Float phi = unit(rng) * 2 * M_PI;
+        Float r = sqrt(max((Float) 0, 1 - z * z));
+        Vector3 origin = center + Vector3(r * cos(phi), r * sin(phi), z) * radius;
+        Vector3 target = Vector3(boxMin.x + unit(rng) * (boxMax.x - boxMin.x), boxMin.y + unit(rng) * (boxMax.y - boxMin.y),
+                                 boxMin.z + unit(rng) * (boxMax.z - boxMin.z));
+        rays[i] = Ray(origin, (target - origin).normalized());
+    }
+    return rays;
+}
+
+template <typename T>
+static void BenchmarkShapes(const string& name, vector<shared_ptr<T>>& shapes, double& sink)
+{
+    vector<Ray> rays = MakeRays(Vector3(-1, -1, -1), Vector3(1, 1, 1), NUM_RAYS, 2);
+    RunBenchmark(name, NUM_RAYS, [&](int i)
+    {
+        RayHit hit;
+        return shapes[i % shapes.size()]->Intersect(rays[i], hit) ? hit.t : 0;
+    }, sink);
+}
+
+// the oldInputs scenes give their meshes relative to that folder, so they're loaded from there
+static bool LoadMesh(string sceneFile, Scene& scene)
+{
+    Camera camera;
+    TxtReader reader;
+    scene.AddDefaultMaterial();
+
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr || chdir("oldInputs") != 0)
+    {
+        return false;
+    }
+    int result = reader.parseInput(sceneFile, scene, camera);
+    if (chdir(cwd) != 0 || result != 0 || scene.GetNumShapes() == 0)
+    {
+        return false;
+    }
+
+    scene.InitializeAccelerators();
+    return true;
+}
+
+static void BenchmarkMesh(string sceneFile, double& sink)
+{
+    Scene scene;
+    if (!LoadMesh(sceneFile, scene))
+    {
+        cout << "  could not load oldInputs/" << sceneFile << ", run make bench from the top folder" << endl;
+        return;
+    }
+
+    Vector3 boxMin = scene.verts[0];
+    Vector3 boxMax = scene.verts[0];
+    for (int i = 1; i < scene.verts.size(); i++)
+    {
+        boxMin = Vector3::Min(boxMin, scene.verts[i]);
+        boxMax = Vector3::Max(boxMax, scene.verts[i]);
+    }
+
+    vector<Ray> rays = MakeRays(boxMin, boxMax, NUM_MESH_RAYS, 3);
+    vector<int> ignoreList;
+    string name = "bvh " + sceneFile.substr(0, sceneFile.find('.')) + " (" + to_string(scene.GetNumShapes()) + " tris)";
+    RunBenchmark(name, NUM_MESH_RAYS, [&](int i)
+    {
+        RayHit hit;
+        return scene.Intersect(rays[i], hit, ignoreList) ? hit.t : 0;
+    }, sink);
+}
+
+int main(int argc, char* argv[])
+{
+    double sink = 0;
+
+#ifndef __OPTIMIZE__
+    cout << "Built without optimizations, use make bench CXXFLAGS=\"-O2 -std=c++11 -pthread\" (after a make clean) for useful numbers" << endl;
+#endif
+    cout << NUM_RAYS << " inputs per benchmark (" << NUM_MESH_RAYS << " for the meshes), best of at least 3 passes" << endl;
+
+    mt19937 rng(1);
+    uniform_real_distribution<Float> unit(0, 1);
+    auto randomPoint = [&](Float scale) { return Vector3(unit(rng) * 2 - 1, unit(rng) * 2 - 1, unit(rng) * 2 - 1) * scale; };
+
+    cout << "Shapes:" << endl;
+    vector<shared_ptr<Sphere>> spheres;
+    vector<shared_ptr<Cylinder>> cylinders;
+    vector<shared_ptr<Triangle>> triangles;
+    vector<shared_ptr<Shape>> boxShapes;
+    for (int i = 0; i < NUM_SHAPES; i++)
+    {
+        spheres.push_back(make_shared<Sphere>(randomPoint(0.5), 0, 0.2 + unit(rng) * 0.3));
+        cylinders.push_back(make_shared<Cylinder>(randomPoint(0.5), randomPoint(1).normalized(), 0, 0.1 + unit(rng) * 0.2, 0.5 + unit(rng)));
+        Vector3 corner = randomPoint(0.5);
+        triangles.push_back(make_shared<Triangle>(corner, corner + randomPoint(0.5), corner + randomPoint(0.5), 0));
+    }
+    BenchmarkShapes("Sphere::Intersect", spheres, sink);
+    BenchmarkShapes("Cylinder::Intersect", cylinders, sink);
+    BenchmarkShapes("Triangle::Intersect", triangles, sink);
+
+    for (int i = 0; i < spheres.size(); i++)
+    {
+        boxShapes.push_back(spheres[i]);
+    }
+    BoundingVolume box(boxShapes, 0, 0, NUM_SHAPES);
+    vector<Ray> boxRays = MakeRays(Vector3(-1.5, -1.5, -1.5), Vector3(1.5, 1.5, 1.5), NUM_RAYS, 4);
+    RunBenchmark("BoundingVolume::IntersectBoundingBox", NUM_RAYS, [&](int i) { return box.IntersectBoundingBox(boxRays[i]); }, sink);
+
+    cout << "BVH traversal:" << endl;
+    BenchmarkMesh("bunny.txt", sink);
+    BenchmarkMesh("teapot.txt", sink);
+
+    cout << "Shading:" << endl;
+    shared_ptr<Image> texture = make_shared<Image>();
+    if (Image::LoadFromFile("oldInputs/textures/woodDiff.png", texture) == 0)
+    {
+        texture->GenerateMipmaps();
+        vector<UV> uvs(NUM_RAYS);
+        vector<Float> footprints(NUM_RAYS);
+        for (int i = 0; i < NUM_RAYS; i++)
+        {
+            uvs[i] = UV(unit(rng), unit(rng));
+            footprints[i] = pow(2, -10 * unit(rng));
+        }
+        RunBenchmark("Image::GetColorUV bilinear", NUM_RAYS, [&](int i) { return texture->GetColorUV(uvs[i].u, uvs[i].v).x; }, sink);
+        RunBenchmark("Image::GetColorUV trilinear", NUM_RAYS, [&](int i) { return texture->GetColorUV(uvs[i].u, uvs[i].v, footprints[i]).x; }, sink);
+        RunBenchmark("Image::GetColorUV anisotropic", NUM_RAYS, [&](int i)
+        {
+            UV duvdx(footprints[i], 0);
+            UV duvdy(0, footprints[i] * 0.25);
+            return texture->GetColorUV(uvs[i], duvdx, duvdy).x;
+        }, sink);
+
+        // there's no hdr image in the repo, but any lat-long image exercises the same lookups
+        Scene scene;
+        scene.SetHDRI(texture);
+
+        // directions with differentials about a pixel apart at 512x512, like camera rays that missed
+        vector<Ray> envRays(NUM_RAYS);
+        for (int i = 0; i < NUM_RAYS; i++)
+        {
+            Vector3 dir = randomPoint(1).normalized();
+            envRays[i] = Ray(Vector3::zero, dir);
+            envRays[i].hasDifferentials = true;
+            envRays[i].rxDirection = (dir + randomPoint(0.002)).normalized();
+            envRays[i].ryDirection = (dir + randomPoint(0.002)).normalized();
+        }
+        RunBenchmark("Scene::SampleHDRI", NUM_RAYS, [&](int i) { return scene.SampleHDRI(envRays[i]).x; }, sink);
+        for (int i = 0; i < NUM_RAYS; i++)
+        {
+            envRays[i].roughness = unit(rng);
+        }
+        RunBenchmark("Scene::SampleHDRI rough", NUM_RAYS, [&](int i) { return scene.SampleHDRI(envRays[i]).x; }, sink);
+    }
+    else
+    {
+        cout << "  could not load oldInputs/textures/woodDiff.png, run make bench from the top folder" << endl;
+    }
+
+    Material material(Vector3(0.8, 0.6, 0.4), Vector3(1, 1, 1), 0.2, 0.6, 0.4, 32, 1, 1);
+    vector<MaterialSample> samples(NUM_RAYS);
+    vector<Float> diffuseAmts(NUM_RAYS);
+    vector<Float> specularAmts(NUM_RAYS);
+    for (int i = 0; i < NUM_RAYS; i++)
+    {
+        samples[i].diffuse = Vector3(unit(rng), unit(rng), unit(rng));
+        samples[i].specFalloff = 1 + unit(rng) * 127;
+        diffuseAmts[i] = unit(rng) * 2 - 1;
+        specularAmts[i] = unit(rng) * 2 - 1;
+    }
+    RunBenchmark("Material::GetColorNoAmbient", NUM_RAYS, [&](int i)
+    {
+        Vector3 diffuse, specular;
+        return material.GetColorNoAmbient(samples[i], diffuseAmts[i], specularAmts[i], Vector3(1, 1, 1), diffuse, specular).x;
+    }, sink);
+
+    // print the sink so the timed loops can't be thrown away
+    cout << "  (checksum " << sink << ")" << endl;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,321 @@
+// renders a fixed set of scenes under a few thread counts, built and run with make regress. each run
+// records its render time, rays per second and how well it scales with the threads, and compares the
+// image against a stored reference, so a performance change can be checked for both speed and not
+// breaking the image. the results go to a json file (with sorted keys) that can be diffed between runs
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+
+#include "core/TxtReader.h"
+
+using namespace std;
+
+struct RegressionScene
+{
+    const char* directory;  // the scene's paths are relative to this, so it's loaded from here
+    const char* sceneFile;  // relative to the directory
+    const char* reference;  // relative to the top folder
+    double minPSNR;         // below this the run fails
+};
+
+// the stored references come from older versions of the renderer, so most don't match exactly. the
+// thresholds sit just under what the renderer got when they were set, so any change to the images
+// shows up, and the ones marked 60 matched exactly
+static const RegressionScene SCENES[] = {
+    { ".", "hw1c/single_triangle_flat.txt", "hw1c/single_triangle_flat_mine.ppm", 60 },
+    { ".", "hw1c/multiple_triangles_flat.txt", "hw1c/multiple_triangles_flat_mine.ppm", 60 },
+    { ".", "hw1c/partialcube.txt", "hw1c/partialcube_mine.ppm", 22 },
+    { ".", "hw1d/hw1d_first_sample.txt", "hw1d/first3_mine.ppm", 60 },
+    { ".", "hw1d/hw1d_second_sample_lesslighting.txt", "hw1d/second5__mine.ppm", 60 },
+    { ".", "hw1d/hw1d_refraction_sample.txt", "hw1d/refraction_mine.ppm", 40 },
+    { "oldInputs", "test.txt", "oldInputs/test.ppm", 55 },
+    { "oldInputs", "input.txt", "oldInputs/input.ppm", 24.5 },
+    { "oldInputs", "ico_hard.txt", "oldInputs/ico_hard.ppm", 34 },
+    { "oldInputs", "ico_smooth.txt", "oldInputs/ico_smooth.ppm", 34 },
+    { "oldInputs", "teapot.txt", "oldInputs/teapot.ppm", 30 },
+    { "oldInputs", "bunny.txt", "oldInputs/bunny.ppm", 22 },
+};
+
+static const int PIXEL_TOLERANCE = 8;       // out of 255, pixels differing by more in any channel get counted
+static const double IDENTICAL_PSNR = 100;   // reported for identical images rather than infinity
+
+struct ImageDifference
+{
+    double psnr;
+    int maxDiff;
+    double overTolerance;   // fraction of pixels
+};
+
+// both images should have been loaded from 8 bit ppms, so every channel is a multiple of 1 / 255
+static bool CompareImages(Image& a, Image& b, ImageDifference& diff)
+{
+    if (a.GetWidth() != b.GetWidth() || a.GetHeight() != b.GetHeight())
+    {
+        return false;
+    }
+
+    double sumSquared = 0;
+    int over = 0;
+    diff.maxDiff = 0;
+    for (int y = 0; y < a.GetHeight(); y++)
+    {
+        for (int x = 0; x < a.GetWidth(); x++)
+        {
+            Vector3 d = (a.GetPixel(x, y) - b.GetPixel(x, y)) * 255;
+            int dx = (int) round(fabs(d.x));
+            int dy = (int) round(fabs(d.y));
+            int dz = (int) round(fabs(d.z));
+            int largest = max(dx, max(dy, dz));
+            sumSquared += dx * dx + dy * dy + dz * dz;
+            diff.maxDiff = max(diff.maxDiff, largest);
+            over += largest > PIXEL_TOLERANCE ? 1 : 0;
+        }
+    }
+
+    int pixels = a.GetWidth() * a.GetHeight();
+    double mse = sumSquared / (3.0 * pixels);
+    diff.psnr = mse > 0 ? min(IDENTICAL_PSNR, 10 * log10(255 * 255 / mse)) : IDENTICAL_PSNR;
+    diff.overTolerance = (double) over / pixels;
+    return true;
+}
+
+// renders the scene with the given number of threads and loads the image back from the ppm it was saved
+// to, so it's quantized the same way as the reference
+static bool RenderScene(const RegressionScene& entry, unsigned int threads, string imageFile, shared_ptr<Image> image, json& run)
+{
+    Scene scene;
+    Camera camera;
+    TxtReader reader;
+
+    scene.AddDefaultMaterial();
+
+    auto setupStart = chrono::steady_clock::now();
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr || chdir(entry.directory) != 0)
+    {
+        return false;
+    }
+    int result = reader.parseInput(entry.sceneFile, scene, camera);
+    if (chdir(cwd) != 0 || result != 0)
+    {
+        return false;
+    }
+
+    camera.SetDistToPlane(1);
+    camera.SetThreads(threads);
+    if (!camera.IsValid())
+    {
+        return false;
+    }
+    scene.InitializeAccelerators();
+    double setupSeconds = chrono::duration<double>(chrono::steady_clock::now() - setupStart).count();
+
+    // the render threads flush their counters as they finish, so the difference is this render's rays
+    RenderCounters before = RenderCounters::GetTotals();
+    Image output;
+    auto renderStart = chrono::steady_clock::now();
+    if (camera.RenderScene(scene, output) != 0)
+    {
+        return false;
+    }
+    double renderSeconds = chrono::duration<double>(chrono::steady_clock::now() - renderStart).count();
+    RenderCounters rays = RenderCounters::GetTotals().Since(before);
+    uint64_t totalRays = rays.GetRays() + rays.counts[COUNT_SHADOW_RAYS];
+
+    run["threads"] = threads;
+    run["setup_seconds"] = setupSeconds;
+    run["render_seconds"] = renderSeconds;
+    run["rays"] = totalRays;
+    run["rays_per_second"] = totalRays / renderSeconds;
+
+    scene.ClearShapes();
+    return output.SaveToFilePPM(imageFile) == 0 && Image::LoadFromFilePPM(imageFile, image) == 0;
+}
+
+// thread counts come as a comma separated list, like 1,2,4,8
+static bool ParseThreads(string list, vector<unsigned int>& threads)
+{
+    threads.clear();
+    istringstream iss(list);
+    string token;
+    while (getline(iss, token, ','))
+    {
+        int count = atoi(token.c_str());
+        if (count < 1)
+        {
+            return false;
+        }
+        threads.push_back(count);
+    }
+    return threads.size() > 0;
+}
+
+int main(int argc, char* argv[])
+{
+    string outputFile = "regress.json";
+    string imageDir;
+    string filter;
+    vector<unsigned int> threadCounts = { 1 };
+    for (unsigned int n = 2; n < thread::hardware_concurrency(); n *= 2)
+    {
+        threadCounts.push_back(n);
+    }
+    if (thread::hardware_concurrency() > 1)
+    {
+        threadCounts.push_back(thread::hardware_concurrency());
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--output" && i + 1 < argc)
+        {
+            outputFile = argv[++i];
+        }
+        else if (arg == "--images" && i + 1 < argc)
+        {
+            imageDir = argv[++i];
+        }
+        else if (arg == "--scenes" && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (arg == "--threads" && i + 1 < argc && ParseThreads(argv[++i], threadCounts))
+        {
+            continue;
+        }
+        else
+        {
+            cout << "Usage: " << argv[0] << " [--threads <n,n,...>] [--scenes <name_filter>] [--output <results.json>] [--images <dir>]\n";
+            return 1;
+        }
+    }
+
+    json results;
+    results["threads"] = threadCounts;
+    results["pixel_tolerance"] = PIXEL_TOLERANCE;
+    json scenes = json::array();
+    int failures = 0;
+
+    for (const RegressionScene& entry : SCENES)
+    {
+        string name = string(entry.directory) == "." ? entry.sceneFile : string(entry.directory) + "/" + entry.sceneFile;
+        if (name.find(filter) == string::npos)
+        {
+            continue;
+        }
+
+        json sceneResult;
+        sceneResult["scene"] = name;
+        sceneResult["reference"] = entry.reference;
+        sceneResult["min_psnr"] = entry.minPSNR;
+        bool passed = true;
+
+        Image reference;
+        if (Image::LoadFromFilePPM(entry.reference, reference) != 0)
+        {
+            passed = false;
+        }
+
+        cout << name << ":" << endl;
+        json runs = json::array();
+        shared_ptr<Image> firstImage;
+        double firstSeconds = 0;
+        for (int t = 0; t < threadCounts.size() && passed; t++)
+        {
+            // the images go to a temporary file unless they should be kept
+            string imageFile;
+            if (!imageDir.empty())
+            {
+                imageFile = imageDir + "/" + name.substr(name.find_last_of('/') + 1);
+                imageFile = imageFile.substr(0, imageFile.find_last_of('.')) + "_" + to_string(threadCounts[t]) + "t.ppm";
+            }
+            else
+            {
+                char tempFile[] = "/tmp/raytracer_regressXXXXXX.ppm";
+                int fd = mkstemps(tempFile, 4);
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+                imageFile = tempFile;
+            }
+
+            shared_ptr<Image> image = make_shared<Image>();
+            json run;
+            bool rendered = RenderScene(entry, threadCounts[t], imageFile, image, run);
+            if (imageDir.empty())
+            {
+                unlink(imageFile.c_str());
+            }
+            if (!rendered)
+            {
+                cout << "  could not render " << name << " with " << threadCounts[t] << " threads" << endl;
+                passed = false;
+                break;
+            }
+
+            ImageDifference diff;
+            if (!CompareImages(*image, reference, diff))
+            {
+                cout << "  image size doesn't match the reference " << entry.reference << endl;
+                passed = false;
+                break;
+            }
+            run["psnr"] = diff.psnr;
+            run["max_diff"] = diff.maxDiff;
+            run["over_tolerance"] = diff.overTolerance;
+
+            // scaling is measured against the first thread count, ideally the time halves as the threads double
+            double seconds = run["render_seconds"];
+            if (t == 0)
+            {
+                firstImage = image;
+                firstSeconds = seconds;
+            }
+            double speedup = firstSeconds / seconds;
+            double efficiency = speedup * threadCounts[0] / threadCounts[t];
+            run["speedup"] = speedup;
+            run["scaling_efficiency"] = efficiency;
+
+            // the image shouldn't depend on how many threads rendered it
+            ImageDifference threadDiff;
+            bool matches = CompareImages(*image, *firstImage, threadDiff) && threadDiff.maxDiff == 0;
+            bool runPassed = matches && diff.psnr >= entry.minPSNR;
+            run["matches_first_run"] = matches;
+            run["passed"] = runPassed;
+            passed = passed && runPassed;
+
+            cout << "  " << setw(3) << threadCounts[t] << " threads: " << fixed << setprecision(3) << seconds << " s, "
+                 << setprecision(2) << (double) run["rays_per_second"] / 1e6 << " Mrays/s, speedup " << speedup
+                 << ", efficiency " << efficiency * 100 << "%, psnr " << diff.psnr << " dB"
+                 << (matches ? "" : ", differs from the first run") << (runPassed ? "" : "  FAILED") << defaultfloat << endl;
+            runs.push_back(run);
+        }
+
+        sceneResult["runs"] = runs;
+        sceneResult["passed"] = passed;
+        scenes.push_back(sceneResult);
+        failures += passed ? 0 : 1;
+    }
+
+    results["scenes"] = scenes;
+    results["failures"] = failures;
+
+    ofstream file(outputFile.c_str());
+    if (!file.is_open())
+    {
+        cout << "Error: Could not open file " << outputFile << endl;
+        return 1;
+    }
+    file << results.dump(4) << endl;
+    file.close();
+
+    cout << scenes.size() - failures << " of " << scenes.size() << " scenes passed, results written to " << outputFile << endl;
+    return failures > 0 ? 1 : 0;
+}
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "BWImage.h"
+#include "RenderStats.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "ext/stb_image.h"
@@ -7,48 +8,78 @@ BWImage::BWImage()
 {
     width = 0;
     height = 0;
-    pixels = nullptr;
 }
 
-BWImage::BWImage(int width, int height)
+BWImage::BWImage(int width, int height, TexelFormat format)
 {
     this->width = width;
     this->height = height;
-    pixels = new float[width * height];
+    pixels.Allocate(width, height, 1, format);
 }
 
 BWImage::~BWImage()
 {
-    if (pixels != nullptr)
-    {
-        delete[] pixels;
-    }
 }
 
-void BWImage::SetDimensions(int width, int height)
+void BWImage::SetDimensions(int width, int height, TexelFormat format)
 {
     this->width = width;
     this->height = height;
-    if (pixels != nullptr)
+    pixels.Allocate(width, height, 1, format);
+    mipmaps.clear();
+    cache = nullptr;
+}
+
+size_t BWImage::GetMemoryUsage()
+{
+    size_t total = pixels.GetMemoryUsage();
+    for (int i = 0; i < mipmaps.size(); i++)
     {
-        delete[] pixels;
+        total += mipmaps[i]->GetMemoryUsage();
+    }
+    return total;
+}
+
+void BWImage::MoveToCache(shared_ptr<TextureCache> cache)
+{
+    if (this->cache != nullptr)
+    {
+        return;
+    }
+
+    firstTile = cache->AddTexels(pixels);
+    pixels.ReleaseTexels();
+    this->cache = cache;
+
+    for (int i = 0; i < mipmaps.size(); i++)
+    {
+        mipmaps[i]->MoveToCache(cache);
     }
-    pixels = new float[width * height];
 }
 
 void BWImage::SetPixel(int x, int y, Float value)
 {
-    if (y * width + x < width * height)
+    if (cache == nullptr && x >= 0 && x < width && y >= 0 && y < height)
     {
-        pixels[y * width + x] = value;
+        float texel = value;
+        pixels.SetTexel(x, y, &texel);
     }
 }
 
 Float BWImage::GetPixel(int x, int y)
 {
-    if (y * width + x < width * height)
+    if (x >= 0 && x < width && y >= 0 && y < height)
     {
-        return pixels[y * width + x];
+        float texel;
+        if (cache != nullptr)
+        {
+            pixels.DecodeTexel(cache->GetTile(firstTile + pixels.GetBlockIndex(x, y)), x, y, &texel);
+        }
+        else
+        {
+            pixels.GetTexel(x, y, &texel);
+        }
+        return texel;
     }
     else
     {
@@ -88,8 +119,8 @@ Float BWImage::GetColorUV(Float u, Float v)
     y1 = y1 % height;
     y2 = y2 % height;
 
-    Float t = u - (int)u; // lerp factor for u
-    Float s = v - (int)v; // lerp factor for v
+    Float t = u * width - (int)(u * width); // lerp factor for u
+    Float s = v * height - (int)(v * height); // lerp factor for v
 
     // get color of 4 closest pixels
     Float p1 = GetPixel(x1, y1);
@@ -105,16 +136,130 @@ Float BWImage::GetColorUV(Float u, Float v)
     return top * s + bottom * (1 - s);
 }
 
+Float BWImage::GetColorUV(Float u, Float v, Float footprint)
+{
+    // pick the mip level where the footprint covers about one texel
+    Float level = log2(max(footprint * max(width, height), (Float) 1e-8));
+    if (!(level > 0) || mipmaps.size() == 0)
+    {
+        return GetColorUV(u, v);
+    }
+
+    int numLevels = mipmaps.size();
+    if (level >= numLevels)
+    {
+        return mipmaps.back()->GetColorUV(u, v);
+    }
+
+    // lerp between the two closest levels
+    int lower = (int) level;
+    Float t = level - lower;
+    Float lowerCol = lower == 0 ? GetColorUV(u, v) : mipmaps[lower - 1]->GetColorUV(u, v);
+    Float upperCol = mipmaps[lower]->GetColorUV(u, v);
+
+    return lowerCol * (1 - t) + upperCol * t;
+}
+
+// takes a few trilinear samples along the longer axis of the footprint, with the mip level picked from the
+// shorter axis, so surfaces at grazing angles don't get blurred as much as a single trilinear lookup would
+Float BWImage::GetColorUV(UV uv, UV duvdx, UV duvdy)
+{
+    const int maxAnisotropy = 8;
+
+    // measure the axes in texels so non-square textures get the right level
+    Float lenX = sqrt(duvdx.u * duvdx.u * width * width + duvdx.v * duvdx.v * height * height);
+    Float lenY = sqrt(duvdy.u * duvdy.u * width * width + duvdy.v * duvdy.v * height * height);
+    UV majorAxis = lenX > lenY ? duvdx : duvdy;
+    Float majorLen = max(lenX, lenY);
+    Float minorLen = min(lenX, lenY);
+
+    if (!(majorLen > 1)) // also catches nan
+    {
+        return GetColorUV(uv.u, uv.v);
+    }
+
+    // clamp the eccentricity, otherwise thin footprints would need a huge number of samples
+    minorLen = max(minorLen, majorLen / maxAnisotropy);
+    int numSamples = min((int) ceil(majorLen / minorLen), maxAnisotropy);
+    Float footprint = minorLen / max(width, height);
+
+    if (numSamples <= 1)
+    {
+        return GetColorUV(uv.u, uv.v, footprint);
+    }
+
+    Float col = 0;
+    for (int i = 0; i < numSamples; i++)
+    {
+        Float offset = (i + 0.5) / numSamples - 0.5;
+        UV sampleUV = uv + majorAxis * offset;
+        col += GetColorUV(sampleUV.u, sampleUV.v, footprint);
+    }
+
+    return col / numSamples;
+}
+
+// builds the mip pyramid by repeatedly averaging 2x2 blocks of the previous level
+void BWImage::GenerateMipmaps()
+{
+    ScopedPhaseTimer timer(PHASE_TEXTURES);
+    mipmaps.clear();
+
+    BWImage* prev = this;
+    while (prev->width > 1 || prev->height > 1)
+    {
+        int newWidth = max(1, prev->width / 2);
+        int newHeight = max(1, prev->height / 2);
+        shared_ptr<BWImage> level = make_shared<BWImage>(newWidth, newHeight, GetFormat());
+
+        for (int y = 0; y < newHeight; y++)
+        {
+            int y1 = min(2 * y, prev->height - 1);
+            int y2 = min(2 * y + 1, prev->height - 1);
+            for (int x = 0; x < newWidth; x++)
+            {
+                int x1 = min(2 * x, prev->width - 1);
+                int x2 = min(2 * x + 1, prev->width - 1);
+                Float sum = prev->GetPixel(x1, y1) + prev->GetPixel(x2, y1) + prev->GetPixel(x1, y2) + prev->GetPixel(x2, y2);
+                level->SetPixel(x, y, sum * 0.25);
+            }
+        }
+
+        mipmaps.push_back(level);
+        prev = level.get();
+    }
+}
+
 int BWImage::LoadFromFile(string fileName, shared_ptr<BWImage> image)
 {
-    // load image
-    float* data = stbi_loadf(fileName.c_str(), &image->width, &image->height, nullptr, 1);
+    ScopedPhaseTimer timer(PHASE_TEXTURES);
+
+    // load image, keeping 8 bit images in 8 bits and 16 bit pngs as halfs
+    int width, height;
+    void* data;
+    TexelFormat format;
+    if (stbi_is_hdr(fileName.c_str()))
+    {
+        data = stbi_loadf(fileName.c_str(), &width, &height, nullptr, 1);
+        format = TEXEL_FLOAT;
+    }
+    else if (stbi_is_16_bit(fileName.c_str()))
+    {
+        data = stbi_load_16(fileName.c_str(), &width, &height, nullptr, 1);
+        format = TEXEL_HALF;
+    }
+    else
+    {
+        data = stbi_load(fileName.c_str(), &width, &height, nullptr, 1);
+        format = TEXEL_U8;
+    }
+
     if (data == nullptr)
     {
         return -1;
     }
 
-    image->SetDimensions(image->width, image->height);
+    image->SetDimensions(width, height, format);
 
     // copy data into image
     // flip y axis
@@ -123,17 +268,27 @@ int BWImage::LoadFromFile(string fileName, shared_ptr<BWImage> image)
     {
         for (int x = 0; x < image->width; x++)
         {
-            image->SetPixel(x, y, data[index]);
+            Float value;
+            if (format == TEXEL_FLOAT)
+            {
+                value = ((float*) data)[index];
+            }
+            else if (format == TEXEL_HALF)
+            {
+                value = ((unsigned short*) data)[index] / 65535.0f;
+            }
+            else
+            {
+                value = ((unsigned char*) data)[index] / 255.0f;
+            }
+            image->SetPixel(x, y, value);
             index++;
         }
     }
 
+    stbi_image_free(data);
+
     image->filepath = fileName;
 
     return 0;
-}
-
-float& BWImage::operator[](int index)
-{
-    return pixels[index];
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 #define BWIMAGE_H
 
 #include "math/Vector3.h"
+#include "TexelBuffer.h"
+#include "TextureCache.h"
 
 #include <iostream>
 #include <fstream>
@@ -16,23 +18,32 @@ class BWImage
         string filepath;
 
         BWImage();
-        BWImage(int width, int height);
+        BWImage(int width, int height, TexelFormat format = TEXEL_FLOAT);
         ~BWImage();
 
-        void SetDimensions(int width, int height);
+        void SetDimensions(int width, int height, TexelFormat format = TEXEL_FLOAT);
+        TexelFormat GetFormat() { return pixels.GetFormat(); }
+        size_t GetMemoryUsage();                // bytes used by the texels, including mip levels
+        void MoveToCache(shared_ptr<TextureCache> cache);   // pages the texels (and mip levels) out to the cache
 
         void SetPixel(int x, int y, Float value);
         Float GetPixel(int x, int y);
         Float GetColorUV(Float u, Float v);
+        Float GetColorUV(Float u, Float v, Float footprint);   // trilinear lookup for a filter width in uv space
+        Float GetColorUV(UV uv, UV duvdx, UV duvdy);           // anisotropic lookup using the uv screen space derivatives
 
-        static int LoadFromFile(string fileName, shared_ptr<BWImage> image);
+        void GenerateMipmaps();
+        int GetNumMipLevels() { return mipmaps.size() + 1; }
 
-        float& operator[](int);
+        static int LoadFromFile(string fileName, shared_ptr<BWImage> image);
 
     private:
         int width;
         int height;
-        float* pixels; // using float rather than Float bc that's what stb_image uses
+        TexelBuffer pixels;
+        shared_ptr<TextureCache> cache;     // set once the texels live in the texture cache, read only after that
+        int firstTile = 0;
+        vector<shared_ptr<BWImage>> mipmaps; // levels 1 and up, level 0 is this image
 
 };
 
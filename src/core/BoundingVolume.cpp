@@ -1,4 +1,5 @@
 #include "BoundingVolume.h"
+#include "RenderStats.h"
 
 BoundingVolume::BoundingVolume(vector<shared_ptr<Shape>> shapes, int depth, int maxDepth, int idealShapes)
 {
@@ -22,12 +23,17 @@ void BoundingVolume::CalculateBounds()
 
 bool BoundingVolume::Intersect(Ray ray, RayHit& hitInfo, vector<int>& ignoreList)
 {
+    CountRender(COUNT_NODES);
     RayHit tempHitInfo;
 
-    // first check that ray hits the bounding box
-    if (!IsPointInside(ray.origin) && IntersectBoundingBox(ray) < 0)
+    // first check that ray hits the bounding box, and that it does so before the closest hit found so far
+    if (!IsPointInside(ray.origin))
     {
-        return false;
+        double boxDist = IntersectBoundingBox(ray);
+        if (boxDist < 0 || (hitInfo && boxDist > hitInfo.t))
+        {
+            return false;
+        }
     }
 
     // first check collisions with shapes in this BV
@@ -50,6 +56,8 @@ bool BoundingVolume::Intersect(Ray ray, RayHit& hitInfo, vector<int>& ignoreList
     // then check collisions with sub-BVs
     for (shared_ptr<BoundingVolume> subVolume : subVolumes)
     {
+        // pass in the closest hit so far so the sub-BV can skip anything behind it
+        tempHitInfo = hitInfo;
         if (subVolume->Intersect(ray, tempHitInfo, ignoreList))
         {
             if (!hitInfo || tempHitInfo.t < hitInfo.t)
@@ -62,6 +70,124 @@ bool BoundingVolume::Intersect(Ray ray, RayHit& hitInfo, vector<int>& ignoreList
     return hitInfo.hit;
 }
 
+// same as Intersect but for every active ray in the packet at once, each ray ends up with the same hit
+// it would have got on its own
+void BoundingVolume::IntersectPacket(RayPacket& packet, vector<int>& ignoreList, unsigned int active)
+{
+    // counted per ray, so the counts match tracing the rays one at a time
+    CountRender(COUNT_NODES, __builtin_popcount(active));
+
+    if (packet.coherent && FrustumMisses(packet))
+    {
+        return;
+    }
+
+    // slab test for each ray, keeping the ones that reach the box before their closest hit so far
+    unsigned int mask = 0;
+    for (int i = 0; i < packet.size; i++)
+    {
+        Float tx0 = (minBounds.x - packet.ox[i]) * packet.idx[i];
+        Float tx1 = (maxBounds.x - packet.ox[i]) * packet.idx[i];
+        Float ty0 = (minBounds.y - packet.oy[i]) * packet.idy[i];
+        Float ty1 = (maxBounds.y - packet.oy[i]) * packet.idy[i];
+        Float tz0 = (minBounds.z - packet.oz[i]) * packet.idz[i];
+        Float tz1 = (maxBounds.z - packet.oz[i]) * packet.idz[i];
+        Float tNear = max(max(min(tx0, tx1), min(ty0, ty1)), min(tz0, tz1));
+        Float tFar = min(min(max(tx0, tx1), max(ty0, ty1)), max(tz0, tz1));
+        Float tMax = packet.hits[i] ? packet.hits[i].t : INFINITY;
+        bool hit = tNear <= tFar && tFar >= 0 && tNear <= tMax;
+        mask |= (hit ? 1u : 0u) << i;
+    }
+    mask &= active;
+    if (mask == 0)
+    {
+        return;
+    }
+
+    RayHit tempHitInfo;
+    for (shared_ptr<Shape> shape : shapes)
+    {
+        if (count(ignoreList.begin(), ignoreList.end(), shape->id) != 0)
+        {
+            continue;
+        }
+        for (int i = 0; i < packet.size; i++)
+        {
+            if ((mask & (1u << i)) == 0 || packet.ignoreShapes[i] == shape->id)
+            {
+                continue;
+            }
+            if (shape->Intersect(*packet.rays[i], tempHitInfo))
+            {
+                RayHit& hitInfo = packet.hits[i];
+                if (!hitInfo || tempHitInfo.t < hitInfo.t)
+                {
+                    hitInfo = tempHitInfo;
+                    hitInfo.shapeIndex = shape->id;
+                }
+            }
+        }
+    }
+
+    for (shared_ptr<BoundingVolume> subVolume : subVolumes)
+    {
+        subVolume->IntersectPacket(packet, ignoreList, mask);
+    }
+}
+
+void BoundingVolume::CollectStats(int& nodes, vector<int>& leafDepths, vector<int>& leafSizes)
+{
+    nodes++;
+    if (!subVolumes.empty())
+    {
+        for (shared_ptr<BoundingVolume> subVolume : subVolumes)
+        {
+            subVolume->CollectStats(nodes, leafDepths, leafSizes);
+        }
+        return;
+    }
+
+    if (depth >= leafDepths.size())
+    {
+        leafDepths.resize(depth + 1, 0);
+    }
+    if (shapes.size() >= leafSizes.size())
+    {
+        leafSizes.resize(shapes.size() + 1, 0);
+    }
+    leafDepths[depth]++;
+    leafSizes[shapes.size()]++;
+}
+
+// tests the box against the bounds of the packet's origins and directions, true if no ray can hit it
+bool BoundingVolume::FrustumMisses(RayPacket& packet)
+{
+    Float bmin[3] = { minBounds.x, minBounds.y, minBounds.z };
+    Float bmax[3] = { maxBounds.x, maxBounds.y, maxBounds.z };
+    Float omin[3] = { packet.originMin.x, packet.originMin.y, packet.originMin.z };
+    Float omax[3] = { packet.originMax.x, packet.originMax.y, packet.originMax.z };
+    Float dmin[3] = { packet.invDirMin.x, packet.invDirMin.y, packet.invDirMin.z };
+    Float dmax[3] = { packet.invDirMax.x, packet.invDirMax.y, packet.invDirMax.z };
+
+    Float tNear = -INFINITY;
+    Float tFar = INFINITY;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // every ray in the packet heads the same way along the axis, so they all enter and leave through
+        // the same planes. (plane - origin) * invDir is bilinear, so its bounds are at the corners
+        Float entry = dmin[axis] > 0 ? bmin[axis] : bmax[axis];
+        Float exit = dmin[axis] > 0 ? bmax[axis] : bmin[axis];
+        Float e0 = (entry - omin[axis]) * dmin[axis], e1 = (entry - omin[axis]) * dmax[axis];
+        Float e2 = (entry - omax[axis]) * dmin[axis], e3 = (entry - omax[axis]) * dmax[axis];
+        Float x0 = (exit - omin[axis]) * dmin[axis], x1 = (exit - omin[axis]) * dmax[axis];
+        Float x2 = (exit - omax[axis]) * dmin[axis], x3 = (exit - omax[axis]) * dmax[axis];
+        tNear = max(tNear, min(min(e0, e1), min(e2, e3)));
+        tFar = min(tFar, max(max(x0, x1), max(x2, x3)));
+    }
+
+    return tNear > tFar || tFar < 0;
+}
+
 double BoundingVolume::IntersectBoundingBox(Ray ray)
 {
     Float t = -1;
@@ -12,10 +12,14 @@ class BoundingVolume
     public:
         BoundingVolume(vector<shared_ptr<Shape>> shapes, int depth, int maxDepth, int idealShapes);
 
-        bool Intersect(Ray ray, RayHit& hitInfo, vector<int>& ignoreList);
+        bool Intersect(Ray ray, RayHit& hitInfo, vector<int>& ignoreList);  // hitInfo can already hold a hit, only closer ones replace it
+        void IntersectPacket(RayPacket& packet, vector<int>& ignoreList, unsigned int active);  // active has a bit set for each ray to trace
         double IntersectBoundingBox(Ray ray);
         bool IsPointInside(Vector3 point);
 
+        // counts the nodes, and the leaves at each depth and with each number of shapes
+        void CollectStats(int& nodes, vector<int>& leafDepths, vector<int>& leafSizes);
+
     private:
         vector<shared_ptr<Shape>> shapes;
         vector<shared_ptr<BoundingVolume>> subVolumes;
@@ -26,6 +30,7 @@ class BoundingVolume
         int maxDepth;
         int idealShapes;
 
+        bool FrustumMisses(RayPacket& packet);
         void CalculateBounds();
         void ConstructSubVolumes();
         static WorldBounds GetShapesWorldBounds(vector<shared_ptr<Shape>> shapes);
@@ -2,6 +2,12 @@
 
 using namespace std;
 
+// names the aov command takes and the exr layers they get written to, in the order of the AOV enum. the
+// beauty layer is unnamed so viewers show it as the image
+static const char* AOV_NAMES[Camera::NUM_AOVS] = { "beauty", "depth", "normal", "albedo", "shapeid", "materialid", "samples", "time" };
+static const char* AOV_LAYERS[Camera::NUM_AOVS] = { "", "depth", "normal", "albedo", "shapeID", "materialID", "samples", "time" };
+static const char* AOV_CHANNELS[Camera::NUM_AOVS] = { "RGB", "", "XYZ", "RGB", "", "", "", "" };
+
 Camera::Camera()
 {
     parameters_set = 0;
@@ -122,6 +128,7 @@ void Camera::SetAspectRatio(int pixel_width, int pixel_height)
 void Camera::SetGamma(Float gamma)
 {
     this->gamma = gamma;
+    gammaTable.Build(gamma);
 }
 
 void Camera::SetIOR(Float ior)
@@ -144,6 +151,81 @@ void Camera::SetNumBounces(unsigned int num_bounces)
     this->num_bounces = num_bounces;
 }
 
+void Camera::SetWavefrontBatch(unsigned int batchSize)
+{
+    this->wavefrontBatch = batchSize;
+}
+
+void Camera::SetPacketSize(unsigned int packetSize)
+{
+    this->packetSize = packetSize;
+}
+
+void Camera::SetReorderRays(bool reorder)
+{
+    this->reorderRays = reorder;
+}
+
+void Camera::SetDenoisePasses(unsigned int passes)
+{
+    this->denoisePasses = passes;
+}
+
+void Camera::SetHeatmapFile(string fileName)
+{
+    this->heatmapFile = fileName;
+}
+
+void Camera::SetCheckpointFile(string fileName)
+{
+    checkpoint.SetFile(fileName);
+}
+
+void Camera::SetCheckpointInterval(double seconds)
+{
+    checkpoint.SetInterval(seconds);
+}
+
+void Camera::SetAOVFile(string fileName)
+{
+    this->aovFile = fileName;
+}
+
+bool Camera::AddAOV(string name)
+{
+    for (int i = 0; i < NUM_AOVS; i++)
+    {
+        if (name == AOV_NAMES[i])
+        {
+            if (aovLayers[i] < 0)
+            {
+                aovLayers[i] = framebuffer.AddLayer(AOV_LAYERS[i], AOV_CHANNELS[i]);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void Camera::AddAllAOVs()
+{
+    for (int i = 0; i < NUM_AOVS; i++)
+    {
+        AddAOV(AOV_NAMES[i]);
+    }
+}
+
+string Camera::GetAOVNames()
+{
+    string names;
+    for (int i = 0; i < NUM_AOVS; i++)
+    {
+        names += i == 0 ? "" : (i == NUM_AOVS - 1 ? " or " : ", ");
+        names += AOV_NAMES[i];
+    }
+    return names;
+}
+
 Vector3 Camera::GetPosition()
 {
     return position;
@@ -245,6 +327,51 @@ unsigned int Camera::GetNumBounces()
     return num_bounces;
 }
 
+unsigned int Camera::GetWavefrontBatch()
+{
+    return wavefrontBatch;
+}
+
+unsigned int Camera::GetPacketSize()
+{
+    return packetSize;
+}
+
+bool Camera::GetReorderRays()
+{
+    return reorderRays;
+}
+
+unsigned int Camera::GetDenoisePasses()
+{
+    return denoisePasses;
+}
+
+string Camera::GetHeatmapFile()
+{
+    return heatmapFile;
+}
+
+Checkpoint& Camera::GetCheckpoint()
+{
+    return checkpoint;
+}
+
+CostHeatmap& Camera::GetHeatmap()
+{
+    return heatmap;
+}
+
+string Camera::GetAOVFile()
+{
+    return aovFile;
+}
+
+Framebuffer& Camera::GetFramebuffer()
+{
+    return framebuffer;
+}
+
 #pragma endregion
 
 bool Camera::IsValid()
@@ -264,6 +391,13 @@ bool Camera::IsValid()
         return false;
     }
 
+    // the checkpoint only keeps the finished image, not the features, aovs or counters of its pixels
+    if (checkpoint.IsEnabled() && (denoisePasses > 0 || framebuffer.GetNumLayers() > 0 || !heatmapFile.empty()))
+    {
+        std::cout << "ERROR: Checkpoints can't be used with denoising, aovs or the heatmap\n";
+        return false;
+    }
+
     // can add more tests here if necessary
 
     return true;
@@ -301,6 +435,14 @@ Ray Camera::CreateCameraRay(Float x, Float y)
     Vector3 ray_direction = screen_point - position;
 
     Ray ray = Ray(position, ray_direction, ior);
+
+    // differentials are the rays through the neighboring pixels
+    ray.hasDifferentials = true;
+    ray.rxOrigin = position;
+    ray.ryOrigin = position;
+    ray.rxDirection = (ray_direction + screen_right * (screen_width / pixel_width)).normalized();
+    ray.ryDirection = (ray_direction + screen_up * (screen_height / pixel_height)).normalized();
+
     return ray;
 }
 
@@ -311,11 +453,90 @@ int Camera::RenderScene(Scene& scene, Image& output)
     // first initialize output image
     output.SetDimensions(pixel_width, pixel_height);
 
+    // when denoising or writing aovs the pixels are left linear until the end
+    keepFeatures = denoisePasses > 0 || framebuffer.GetNumLayers() > 0;
+    if (denoisePasses > 0)
+    {
+        denoiser.SetDimensions(pixel_width, pixel_height);
+    }
+    framebuffer.SetDimensions(pixel_width, pixel_height);
+    if (!heatmapFile.empty())
+    {
+        heatmap.SetDimensions(pixel_width, pixel_height);
+    }
+
+    if (checkpoint.IsEnabled())
+    {
+        // everything that changes how the pixels come out, along with the scene's files that the checkpoint
+        // adds itself
+        vector<uint32_t> settings = { (uint32_t) pixel_width, (uint32_t) pixel_height, num_samples, num_bounces,
+                                      (uint32_t) scene.GetNumShapes() };
+        Float values[] = { position.x, position.y, position.z, forward.x, forward.y, forward.z, up.x, up.y, up.z,
+                           v_fov, dist_to_plane, aspect_ratio, gamma, ior };
+        for (Float value : values)
+        {
+            uint32_t bits[(sizeof(Float) + 3) / 4] = {};
+            memcpy(bits, &value, sizeof(Float));
+            settings.insert(settings.end(), bits, bits + sizeof(bits) / 4);
+        }
+        if (wavefrontBatch > 0 || packetSize > 0 || reorderRays)
+        {
+            settings.insert(settings.end(), { wavefrontBatch, packetSize, (uint32_t) reorderRays });
+        }
+        checkpoint.Start(pixel_width, pixel_height, num_samples, settings);
+
+        int rows = checkpoint.Load(output);
+        if (rows > 0)
+        {
+            cout << "Resuming from " << checkpoint.GetFile() << ", " << rows << " of " << pixel_height << " rows already done" << endl;
+        }
+    }
+
+    if (scene.GetTextureCache() != nullptr)
+    {
+        scene.GetTextureCache()->SetThreads(threads);
+    }
+    RenderRows(scene, output);
+
+    if (denoisePasses > 0)
+    {
+        cout << "Denoising..." << endl;
+        ScopedTrace trace("denoise", "render");
+        denoiser.Denoise(output, denoisePasses, threads);
+    }
+
+    if (keepFeatures)
+    {
+        for (int y = 0; y < pixel_height; y++)
+        {
+            for (int x = 0; x < pixel_width; x++)
+            {
+                if (aovLayers[AOV_BEAUTY] >= 0)
+                {
+                    framebuffer.SetPixel(aovLayers[AOV_BEAUTY], x, y, output.GetPixel(x, y));
+                }
+                output.SetPixel(x, y, GammaCorrect(output.GetPixel(x, y)));
+            }
+        }
+    }
+
+    return 0;
+}
+
+// splits the rows up between the threads
+void Camera::RenderRows(Scene& scene, Image& output)
+{
+    if (checkpoint.IsEnabled())
+    {
+        RenderRowsCheckpointed(scene, output, threads == 1 ? 1 : min(threads, (unsigned int) pixel_height));
+        return;
+    }
+
     // first see if we need to use multithreading
     if (threads == 1)
     {
         RenderScenePartial(scene, output, 0, pixel_height);
-        return 0;
+        return;
     }
 
     unsigned int numThreads = min(threads, thread::hardware_concurrency()); // don't use more threads than available
@@ -337,26 +558,86 @@ int Camera::RenderScene(Scene& scene, Image& output)
     {
         threads[i].join();
     }
+}
 
-    return 0;
+// the rows are rendered on worker threads (even if there's only one) while this thread saves the
+// checkpoint every interval until they're done
+void Camera::RenderRowsCheckpointed(Scene& scene, Image& output, unsigned int numThreads)
+{
+    mutex finishedMutex;
+    condition_variable finishedCondition;
+    unsigned int finished = 0;
+
+    vector<thread> workers;
+    for (unsigned int i = 0; i < numThreads; i++)
+    {
+        int startRow = i * pixel_height / numThreads;
+        int endRow = (i + 1) * pixel_height / numThreads;
+        workers.push_back(thread([&, startRow, endRow]()
+        {
+            RenderScenePartial(scene, output, startRow, endRow);
+            lock_guard<mutex> lock(finishedMutex);
+            finished++;
+            finishedCondition.notify_one();
+        }));
+    }
+
+    unique_lock<mutex> lock(finishedMutex);
+    chrono::duration<double> interval(checkpoint.GetInterval());
+    while (!finishedCondition.wait_for(lock, interval, [&]() { return finished == numThreads; }))
+    {
+        lock.unlock();
+        checkpoint.Save(output);
+        lock.lock();
+    }
+    lock.unlock();
+
+    for (unsigned int i = 0; i < numThreads; i++)
+    {
+        workers[i].join();
+    }
 }
 
 // assume setup from RenderScene has already been done
 // renders rows from yStart (inclusive) to yEnd (exclusive)
 void Camera::RenderScenePartial(Scene& scene, Image& output, int yStart, int yEnd)
 {
+    ScopedTrace trace("rows", "render", "first_row", yStart);
+    auto threadStart = chrono::steady_clock::now();
+    if (wavefrontBatch > 0 || packetSize > 0 || reorderRays)
+    {
+        RenderScenePartialWavefront(scene, output, yStart, yEnd);
+        RenderCounters::FlushLocal(chrono::duration<double>(chrono::steady_clock::now() - threadStart).count());
+        return;
+    }
+
     Ray ray;
     Vector3 color;
-    int pixel_index = yStart * pixel_width;
     Float x_offset;
     Float y_offset;
+    vector<SurfaceFeatures> features(num_samples);
+    vector<Vector3> sampleColors(num_samples);
 
     // for each pixel, generate ray and use scene to trace it
     for (int y = yStart; y < yEnd; y++)
     {
+        // already loaded from the checkpoint
+        if (checkpoint.IsEnabled() && checkpoint.IsRowDone(y))
+        {
+            continue;
+        }
+
+        ScopedTrace rowTrace("row", "render", "y", y);
+
+        // the start of a row is nowhere near the end of the last one, so its cached occluders won't help
+        scene.ResetShadowCache();
+
         for (int x = 0; x < pixel_width; x++)
         {
+            auto pixelStart = chrono::steady_clock::now();
+            RenderCounters countersStart = RenderCounters::Local();
             color = Vector3(0.0f, 0.0f, 0.0f);
+            SeedRandom((uint64_t) y * pixel_width + x);
 
             // trace each sample with random offset inside pixel
             for (int i = 0; i < num_samples; i++)
@@ -368,21 +649,186 @@ void Camera::RenderScenePartial(Scene& scene, Image& output, int yStart, int yEn
                 }
                 else
                 {
-                    x_offset = (Float) rand() / (Float) RAND_MAX;
-                    y_offset = (Float) rand() / (Float) RAND_MAX;
+                    x_offset = RandomFloat();
+                    y_offset = RandomFloat();
                 }
                 ray = CreateCameraRay(x + x_offset, y + y_offset);
+                ray.ScaleDifferentials(1 / sqrt((Float) num_samples));
                 Float dist;
-                color += scene.TraceRay(ray, num_bounces, dist);
+                sampleColors[i] = scene.TraceRay(ray, num_bounces, dist, keepFeatures ? &features[i] : nullptr);
+                color += sampleColors[i];
+            }
+
+            color /= num_samples;
+            Float seconds = chrono::duration<Float>(chrono::steady_clock::now() - pixelStart).count();
+            StorePixel(output, x, y, color, features.data(), sampleColors.data(), seconds, RenderCounters::Local().Since(countersStart));
+        }
+
+        if (checkpoint.IsEnabled())
+        {
+            checkpoint.AddPixels(y, pixel_width);
+        }
+    }
+
+    RenderCounters::FlushLocal(chrono::duration<double>(chrono::steady_clock::now() - threadStart).count());
+}
+
+// same as above, but generates the camera rays for a batch of pixels at a time and traces them breadth first
+void Camera::RenderScenePartialWavefront(Scene& scene, Image& output, int yStart, int yEnd)
+{
+    WavefrontIntegrator integrator(scene, packetSize, reorderRays);
+    vector<Ray> rays;
+    vector<Vector3> colors;
+    vector<SurfaceFeatures> features;
+    Float x_offset;
+    Float y_offset;
+
+    // packets on their own still need batches to make packets from
+    int batchSize = wavefrontBatch > 0 ? wavefrontBatch : 4096;
+    int pixelsPerBatch = max(1, (int) (batchSize / num_samples));
+
+    // batches sit on a grid over the whole image and each is traced by the thread its first pixel belongs
+    // to, even if it runs into the next thread's rows, so they (and their random numbers) don't depend on
+    // how the rows were split up
+    int first = (yStart * pixel_width + pixelsPerBatch - 1) / pixelsPerBatch * pixelsPerBatch;
+    int last = yEnd * pixel_width;
+    for (int batchStart = first; batchStart < last; batchStart += pixelsPerBatch)
+    {
+        int batchEnd = min(batchStart + pixelsPerBatch, pixel_width * pixel_height);
+
+        // skip batches the checkpoint already has all the rows of, a batch that's only partly done is
+        // still traced whole so its random numbers come out the same
+        bool done = checkpoint.IsEnabled();
+        for (int y = batchStart / pixel_width; y <= (batchEnd - 1) / pixel_width && done; y++)
+        {
+            done = checkpoint.IsRowDone(y);
+        }
+        if (done)
+        {
+            continue;
+        }
+
+        ScopedTrace batchTrace("batch", "render", "first_pixel", batchStart);
+
+        // generate the rays for every sample of every pixel in the batch
+        rays.clear();
+        SeedRandom(batchStart);
+        for (int p = batchStart; p < batchEnd; p++)
+        {
+            int x = p % pixel_width;
+            int y = p / pixel_width;
+            for (int i = 0; i < num_samples; i++)
+            {
+                if (num_samples == 1)
+                {
+                    x_offset = 0.5;
+                    y_offset = 0.5;
+                }
+                else
+                {
+                    x_offset = RandomFloat();
+                    y_offset = RandomFloat();
+                }
+                Ray ray = CreateCameraRay(x + x_offset, y + y_offset);
+                ray.ScaleDifferentials(1 / sqrt((Float) num_samples));
+                rays.push_back(ray);
+            }
+        }
+
+        // the batch covers a different part of the image than the last one
+        scene.ResetShadowCache();
+        auto batchTime = chrono::steady_clock::now();
+        RenderCounters countersStart = RenderCounters::Local();
+        integrator.Trace(rays, num_bounces, colors, keepFeatures ? &features : nullptr);
+
+        // the pixels were traced together, so they each get an even share of the batch's time and counts
+        Float seconds = chrono::duration<Float>(chrono::steady_clock::now() - batchTime).count() / (batchEnd - batchStart);
+        RenderCounters batchCounters = RenderCounters::Local().Since(countersStart);
+        uint64_t batchPixels = batchEnd - batchStart;
+
+        for (int p = batchStart; p < batchEnd; p++)
+        {
+            Vector3 color = Vector3(0.0f, 0.0f, 0.0f);
+            for (int i = 0; i < num_samples; i++)
+            {
+                color += colors[(p - batchStart) * num_samples + i];
             }
 
             color /= num_samples;
-            output[pixel_index] = GammaCorrect(color);
-            pixel_index++;
+            int firstSample = (p - batchStart) * num_samples;
+            RenderCounters counters;
+            for (int i = 0; i < NUM_RENDER_COUNTERS; i++)
+            {
+                // hand out the remainder one at a time so the pixels still add up to the batch's counts
+                uint64_t count = batchCounters.counts[i];
+                counters.counts[i] = count / batchPixels + ((uint64_t) (p - batchStart) < count % batchPixels ? 1 : 0);
+            }
+            if (checkpoint.IsEnabled() && checkpoint.IsRowDone(p / pixel_width))
+            {
+                continue;
+            }
+            StorePixel(output, p % pixel_width, p / pixel_width, color,
+                       keepFeatures ? &features[firstSample] : nullptr, &colors[firstSample], seconds, counters);
+            if (checkpoint.IsEnabled())
+            {
+                checkpoint.AddPixels(p / pixel_width, 1);
+            }
         }
     }
 }
 
+// features and colors hold the pixel's samples, they're only used if keepFeatures is set
+void Camera::StorePixel(Image& output, int x, int y, Vector3 color, const SurfaceFeatures* features, const Vector3* colors, Float seconds,
+                        const RenderCounters& counters)
+{
+    if (!heatmapFile.empty())
+    {
+        heatmap.SetPixel(x, y, counters);
+    }
+
+    if (!keepFeatures)
+    {
+        output.SetPixel(x, y, GammaCorrect(color));
+        return;
+    }
+
+    output.SetPixel(x, y, color);
+    if (denoisePasses > 0)
+    {
+        denoiser.SetFeatures(x, y, features, colors, num_samples);
+    }
+
+    SurfaceFeatures average = SurfaceFeatures::Average(features, num_samples);
+    if (aovLayers[AOV_DEPTH] >= 0)
+    {
+        framebuffer.SetPixel(aovLayers[AOV_DEPTH], x, y, average.depth);
+    }
+    if (aovLayers[AOV_NORMAL] >= 0)
+    {
+        framebuffer.SetPixel(aovLayers[AOV_NORMAL], x, y, average.normal);
+    }
+    if (aovLayers[AOV_ALBEDO] >= 0)
+    {
+        framebuffer.SetPixel(aovLayers[AOV_ALBEDO], x, y, average.albedo);
+    }
+    if (aovLayers[AOV_SHAPE_ID] >= 0)
+    {
+        framebuffer.SetPixel(aovLayers[AOV_SHAPE_ID], x, y, (Float) average.shapeID);
+    }
+    if (aovLayers[AOV_MATERIAL_ID] >= 0)
+    {
+        framebuffer.SetPixel(aovLayers[AOV_MATERIAL_ID], x, y, (Float) average.materialID);
+    }
+    if (aovLayers[AOV_SAMPLES] >= 0)
+    {
+        framebuffer.SetPixel(aovLayers[AOV_SAMPLES], x, y, (Float) num_samples);
+    }
+    if (aovLayers[AOV_TIME] >= 0)
+    {
+        framebuffer.SetPixel(aovLayers[AOV_TIME], x, y, seconds);
+    }
+}
+
 Vector3 Camera::GammaCorrect(Vector3 color)
 {
     if (gamma == 1.0) // don't waste time if gamma is 1
@@ -395,6 +841,6 @@ Vector3 Camera::GammaCorrect(Vector3 color)
     }
     else
     {
-        return Vector3(pow(color.x, 1.0 / gamma), pow(color.y, 1.0 / gamma), pow(color.z, 1.0 / gamma));
+        return Vector3(GammaCorrectChannel(gammaTable, color.x), GammaCorrectChannel(gammaTable, color.y), GammaCorrectChannel(gammaTable, color.z));
     }
 }
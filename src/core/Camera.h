@@ -2,9 +2,15 @@
 #define CAMERA_H
 
 #include "math/Vector3.h"
+#include "math/FastMath.h"
 #include "Ray.h"
 #include "Scene.h"
 #include "Image.h"
+#include "WavefrontIntegrator.h"
+#include "Denoiser.h"
+#include "Framebuffer.h"
+#include "Trace.h"
+#include "Checkpoint.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -12,12 +18,30 @@
 #include <thread>
 #include <vector>
 #include <functional>
+#include <chrono>
+#include <mutex>
+#include <cstring>
+#include <condition_variable>
 
 using namespace std;
 
 class Camera
 {
     public:
+        // extra layers that can be written out alongside the image
+        enum AOV
+        {
+            AOV_BEAUTY,         // the linear image
+            AOV_DEPTH,
+            AOV_NORMAL,
+            AOV_ALBEDO,
+            AOV_SHAPE_ID,
+            AOV_MATERIAL_ID,
+            AOV_SAMPLES,        // camera samples taken for the pixel
+            AOV_TIME,           // seconds spent on the pixel
+            NUM_AOVS
+        };
+
         Camera();
         Camera(Vector3 position, Vector3 forward, Vector3 up, Float v_fov, Float dist_to_plane, int pixel_width, int pixel_height);
 
@@ -45,6 +69,17 @@ class Camera
         void SetThreads(unsigned int threads);
         void SetNumSamples(unsigned int numSamples);
         void SetNumBounces(unsigned int numBounces);
+        void SetWavefrontBatch(unsigned int batchSize);
+        void SetPacketSize(unsigned int packetSize);
+        void SetReorderRays(bool reorder);
+        void SetDenoisePasses(unsigned int passes);
+        void SetAOVFile(string fileName);
+        bool AddAOV(string name);                   // returns false if there's no aov with that name
+        void AddAllAOVs();
+        static string GetAOVNames();                // the names AddAOV takes, for error messages
+        void SetHeatmapFile(string fileName);
+        void SetCheckpointFile(string fileName);
+        void SetCheckpointInterval(double seconds);
 
         Vector3 GetPosition();
         Vector3 GetForward();
@@ -59,6 +94,15 @@ class Camera
         unsigned int GetThreads();
         unsigned int GetNumSamples();
         unsigned int GetNumBounces();
+        unsigned int GetWavefrontBatch();
+        unsigned int GetPacketSize();
+        bool GetReorderRays();
+        unsigned int GetDenoisePasses();
+        string GetAOVFile();
+        Framebuffer& GetFramebuffer();
+        string GetHeatmapFile();
+        CostHeatmap& GetHeatmap();
+        Checkpoint& GetCheckpoint();
 
         Vector3 GetScreenUp();
         Vector3 GetScreenRight();
@@ -88,10 +132,29 @@ class Camera
         Float screen_width;                         // screen width in world space
         Float screen_height;                        // screen height in world space
         Float gamma;                                // gamma correction factor
+        GammaTable gammaTable;                      // 1 / gamma powers for the fast gamma correction
         Float ior = 1;                              // index of refraction where the camera is located
         unsigned int threads = 1;                   // number of threads to use for rendering (1 default = no multithreading)
+        unsigned int wavefrontBatch = 0;            // rays per batch for the wavefront integrator (0 default = depth first)
+        unsigned int packetSize = 0;                // rays per bvh packet, uses the wavefront integrator (0 default = no packets)
+        bool reorderRays = false;                   // sort secondary rays before tracing them, uses the wavefront integrator
+        unsigned int denoisePasses = 0;             // a-trous passes run over the finished image (0 default = no denoising)
+        Denoiser denoiser;                          // holds the first hit features while rendering
+        string aovFile;                             // exr file the aovs get written to (empty default = no aovs)
+        Framebuffer framebuffer;                    // the aov layers
+        int aovLayers[NUM_AOVS] = { -1, -1, -1, -1, -1, -1, -1, -1 }; // framebuffer layer of each aov, -1 if it's not wanted
+        bool keepFeatures = false;                  // pixels stay linear until the end and keep their first hit features
+        string heatmapFile;                         // ppm file the cost heatmap gets written to (empty default = no heatmap)
+        CostHeatmap heatmap;                        // the render counters of every pixel
+        Checkpoint checkpoint;                      // finished rows saved while rendering (no file default = no checkpoints)
+
+        void RenderRows(Scene& scene, Image& output);
+        void RenderRowsCheckpointed(Scene& scene, Image& output, unsigned int numThreads);
+        void StorePixel(Image& output, int x, int y, Vector3 color, const SurfaceFeatures* features, const Vector3* colors, Float seconds,
+                        const RenderCounters& counters);
 
         void RenderScenePartial(Scene& scene, Image& output, int yStart, int yEnd);
+        void RenderScenePartialWavefront(Scene& scene, Image& output, int yStart, int yEnd);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,194 @@
+#include "Checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+static const char MAGIC[8] = { 'R', 'T', 'C', 'H', 'E', 'C', 'K', '1' };
+static const uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+static const uint64_t FNV_PRIME = 0x100000001B3ull;
+
+// 64 bit fnv-1a, continuing from hash
+static uint64_t HashBytes(const void* data, size_t size, uint64_t hash)
+{
+    const unsigned char* bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+Checkpoint::Checkpoint()
+{
+    interval = 60;
+    width = 0;
+    height = 0;
+    samples = 0;
+    sceneHash = FNV_OFFSET;
+}
+
+// hashes the arguments rather than the line, so spacing and comments can change
+void Checkpoint::AddSceneCommand(const string& command, const vector<string>& args)
+{
+    sceneHash = HashBytes(command.c_str(), command.size() + 1, sceneHash);
+    for (int i = 0; i < args.size(); i++)
+    {
+        sceneHash = HashBytes(args[i].c_str(), args[i].size() + 1, sceneHash);
+    }
+}
+
+void Checkpoint::AddInputFile(string fileName)
+{
+    inputFiles.push_back(fileName);
+}
+
+uint64_t Checkpoint::HashInputFiles()
+{
+    uint64_t hash = sceneHash;
+    for (int i = 0; i < inputFiles.size(); i++)
+    {
+        const string& name = inputFiles[i];
+        hash = HashBytes(name.c_str(), name.size() + 1, hash);
+
+        // a missing file hashes as size and time -1
+        struct stat info;
+        int64_t stats[2] = { -1, -1 };
+        if (stat(name.c_str(), &info) == 0)
+        {
+            stats[0] = info.st_size;
+            stats[1] = info.st_mtime;
+        }
+        hash = HashBytes(stats, sizeof(stats), hash);
+    }
+    return hash;
+}
+
+void Checkpoint::Start(int width, int height, unsigned int samples, const vector<uint32_t>& settings)
+{
+    this->width = width;
+    this->height = height;
+    this->samples = samples;
+    this->settings = settings;
+    uint64_t inputHash = HashInputFiles();
+    this->settings.push_back((uint32_t) inputHash);
+    this->settings.push_back((uint32_t) (inputHash >> 32));
+    rowPixels.reset(new atomic<int>[height]);
+    for (int y = 0; y < height; y++)
+    {
+        rowPixels[y] = 0;
+    }
+}
+
+// file layout: magic, the number of settings and the settings, then for every row its sample count and,
+// if that's not 0, its pixels as 32 bit floats. everything is in the machine's byte order
+int Checkpoint::Load(Image& output)
+{
+    FILE* file = fopen(fileName.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return 0;
+    }
+
+    char magic[8];
+    uint32_t count = 0;
+    vector<uint32_t> saved;
+    bool valid = fread(magic, 1, 8, file) == 8 && memcmp(magic, MAGIC, 8) == 0 && fread(&count, 4, 1, file) == 1 && count == settings.size();
+    if (valid)
+    {
+        saved.resize(count);
+        valid = fread(saved.data(), 4, count, file) == count && saved == settings;
+    }
+    if (!valid)
+    {
+        cout << "WARNING: Checkpoint " << fileName << " was made with different settings, starting over" << endl;
+        fclose(file);
+        return 0;
+    }
+
+    // read every row before touching the image, so a truncated file doesn't leave half a checkpoint behind
+    vector<uint32_t> rowSamples(height);
+    vector<float> values;
+    for (int y = 0; y < height && valid; y++)
+    {
+        valid = fread(&rowSamples[y], 4, 1, file) == 1 && (rowSamples[y] == 0 || rowSamples[y] == samples);
+        if (valid && rowSamples[y] > 0)
+        {
+            size_t start = values.size();
+            values.resize(start + width * 3);
+            valid = fread(&values[start], 4, width * 3, file) == (size_t) width * 3;
+        }
+    }
+    fclose(file);
+    if (!valid)
+    {
+        cout << "WARNING: Checkpoint " << fileName << " is damaged, starting over" << endl;
+        return 0;
+    }
+
+    int rows = 0;
+    size_t index = 0;
+    for (int y = 0; y < height; y++)
+    {
+        if (rowSamples[y] == 0)
+        {
+            continue;
+        }
+        for (int x = 0; x < width; x++)
+        {
+            output.SetPixel(x, y, Vector3(values[index], values[index + 1], values[index + 2]));
+            index += 3;
+        }
+        rowPixels[y] = width;
+        rows++;
+    }
+    return rows;
+}
+
+int Checkpoint::Save(Image& output)
+{
+    string tempName = fileName + ".tmp";
+    FILE* file = fopen(tempName.c_str(), "wb");
+    if (file == nullptr)
+    {
+        cout << "Error: Could not open file " << tempName << endl;
+        return 1;
+    }
+
+    uint32_t count = settings.size();
+    bool written = fwrite(MAGIC, 1, 8, file) == 8 && fwrite(&count, 4, 1, file) == 1 && fwrite(settings.data(), 4, count, file) == count;
+    vector<float> row(width * 3);
+    for (int y = 0; y < height && written; y++)
+    {
+        // a row's pixels are all stored before it's marked done, and never change after
+        uint32_t rowSamples = IsRowDone(y) ? samples : 0;
+        written = fwrite(&rowSamples, 4, 1, file) == 1;
+        if (!written || rowSamples == 0)
+        {
+            continue;
+        }
+
+        for (int x = 0; x < width; x++)
+        {
+            Vector3 color = output.GetPixel(x, y);
+            row[x * 3] = color.x;
+            row[x * 3 + 1] = color.y;
+            row[x * 3 + 2] = color.z;
+        }
+        written = fwrite(row.data(), 4, row.size(), file) == row.size();
+    }
+
+    written = fclose(file) == 0 && written;
+    if (!written || rename(tempName.c_str(), fileName.c_str()) != 0)
+    {
+        cout << "Error: Could not write checkpoint " << fileName << endl;
+        remove(tempName.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+void Checkpoint::Remove()
+{
+    remove(fileName.c_str());
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "Image.h"
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+using namespace std;
+
+// The finished rows of a render, saved to disk every so often so a long render that gets killed can pick
+// up where it left off. Every row has its own sample count (rows finish whole, so it's either 0 or the
+// samples per pixel) and, once finished, its pixels as they went into the image. Since the random numbers
+// only depend on the pixel, the rows that are left come out just as they would have without the restart.
+// Files are written next to the checkpoint and renamed over it, so being killed mid write leaves the last
+// checkpoint intact.
+class Checkpoint
+{
+    public:
+        Checkpoint();
+
+        void SetFile(string fileName) { this->fileName = fileName; }
+        string GetFile() { return fileName; }
+        void SetInterval(double seconds) { interval = seconds; }
+        double GetInterval() { return interval; }
+        bool IsEnabled() { return !fileName.empty(); }
+
+        // the scene's commands and the files it loads, they go into the settings so editing any of them
+        // throws the checkpoint away. files go by size and modification time
+        void AddSceneCommand(const string& command, const vector<string>& args);
+        void AddInputFile(string fileName);
+
+        // settings clears the finished rows, and a checkpoint only gets loaded if it was saved with the
+        // same settings (the ones that change what a pixel comes out as)
+        void Start(int width, int height, unsigned int samples, const vector<uint32_t>& settings);
+        int Load(Image& output);    // copies the saved rows into output, returns how many there were
+        int Save(Image& output);    // safe to call while the render threads are still running
+        void Remove();
+
+        bool IsRowDone(int y) { return rowPixels[y].load(memory_order_acquire) >= width; }
+        void AddPixels(int y, int count) { rowPixels[y].fetch_add(count, memory_order_release); }
+
+    private:
+        string fileName;
+        double interval;
+        int width;
+        int height;
+        unsigned int samples;
+        vector<uint32_t> settings;
+        uint64_t sceneHash;
+        vector<string> inputFiles;
+
+        uint64_t HashInputFiles();
+        unique_ptr<atomic<int>[]> rowPixels;   // pixels finished in each row
+};
+
+#endif
\ No newline at end of file
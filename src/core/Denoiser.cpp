@@ -0,0 +1,251 @@
+#include "Denoiser.h"
+
+#include <algorithm>
+#include <thread>
+
+// 1D b3 spline, the 5x5 kernel is the outer product of this with itself
+static const Float KERNEL[5] = { 1.0 / 16, 1.0 / 4, 3.0 / 8, 1.0 / 4, 1.0 / 16 };
+
+// keeps dark albedos from blowing the noise up when dividing by them
+static const Float MIN_ALBEDO = 0.01;
+
+// stops flat areas with no noise from dividing by zero
+static const Float MIN_DEVIATION = 1e-4;
+
+static Float Luminance(Vector3 color)
+{
+    return 0.2126 * color.x + 0.7152 * color.y + 0.0722 * color.z;
+}
+
+static Vector3 Demodulate(Vector3 color, Vector3 albedo)
+{
+    return Vector3(color.x / max(albedo.x, MIN_ALBEDO), color.y / max(albedo.y, MIN_ALBEDO), color.z / max(albedo.z, MIN_ALBEDO));
+}
+
+Denoiser::Denoiser()
+{
+    width = 0;
+    height = 0;
+}
+
+void Denoiser::SetDimensions(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    albedos.assign(width * height, Vector3::zero);
+    normals.assign(width * height, Vector3::zero);
+    depths.assign(width * height, -1);
+    variances.assign(width * height, -1);
+}
+
+// the pixel only counts as a miss if all of its samples missed
+SurfaceFeatures SurfaceFeatures::Average(const SurfaceFeatures* samples, int count)
+{
+    SurfaceFeatures average;
+    average.albedo = Vector3::zero;
+    average.normal = Vector3::zero;
+    average.depth = 0;
+    average.shapeID = samples[0].shapeID;
+    average.materialID = samples[0].materialID;
+
+    int hits = 0;
+    for (int i = 0; i < count; i++)
+    {
+        average.albedo += samples[i].albedo;
+        if (samples[i].depth >= 0)
+        {
+            average.normal += samples[i].normal;
+            average.depth += samples[i].depth;
+            hits++;
+        }
+    }
+
+    average.albedo /= (Float) count;
+    average.normal = hits > 0 ? average.normal / (Float) hits : Vector3::zero;
+    average.depth = hits > 0 ? average.depth / hits : -1;
+    return average;
+}
+
+void Denoiser::SetFeatures(int x, int y, const SurfaceFeatures* samples, const Vector3* colors, int count)
+{
+    SurfaceFeatures average = SurfaceFeatures::Average(samples, count);
+    int ind = y * width + x;
+    albedos[ind] = average.albedo;
+    normals[ind] = average.normal;
+    depths[ind] = average.depth;
+
+    if (count < 2)
+    {
+        variances[ind] = -1;
+        return;
+    }
+
+    // variance of the mean of the samples, which is what ends up in the pixel
+    Float sum = 0;
+    Float sumSq = 0;
+    for (int i = 0; i < count; i++)
+    {
+        Float lum = Luminance(Demodulate(colors[i], albedos[ind]));
+        sum += lum;
+        sumSq += lum * lum;
+    }
+    Float mean = sum / count;
+    variances[ind] = max((Float) 0, sumSq / count - mean * mean) / (count - 1);
+}
+
+static Vector3 Modulate(Vector3 color, Vector3 albedo)
+{
+    return Vector3(color.x * max(albedo.x, MIN_ALBEDO), color.y * max(albedo.y, MIN_ALBEDO), color.z * max(albedo.z, MIN_ALBEDO));
+}
+
+void Denoiser::Denoise(Image& image, int passes, unsigned int threads)
+{
+    vector<Vector3> current(width * height);
+    vector<Vector3> next(width * height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            int ind = y * width + x;
+            current[ind] = Demodulate(image.GetPixel(x, y), albedos[ind]);
+        }
+    }
+
+    // pixels with only one sample don't say how noisy they are, so guess from how much the luminance
+    // varies over the 3x3 pixels around them instead
+    vector<Float> variance = variances;
+    vector<Float> nextVariance(width * height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            if (variance[y * width + x] >= 0)
+            {
+                continue;
+            }
+
+            Float sum = 0;
+            Float sumSq = 0;
+            int count = 0;
+            for (int qy = max(y - 1, 0); qy <= min(y + 1, height - 1); qy++)
+            {
+                for (int qx = max(x - 1, 0); qx <= min(x + 1, width - 1); qx++)
+                {
+                    Float lum = Luminance(current[qy * width + qx]);
+                    sum += lum;
+                    sumSq += lum * lum;
+                    count++;
+                }
+            }
+            Float mean = sum / count;
+            variance[y * width + x] = max((Float) 0, sumSq / count - mean * mean);
+        }
+    }
+
+    unsigned int numThreads = max(1u, min(threads, (unsigned int) height));
+    for (int pass = 0; pass < passes; pass++)
+    {
+        int step = 1 << pass;
+        if (numThreads == 1)
+        {
+            FilterRows(current, variance, next, nextVariance, step, 0, height);
+        }
+        else
+        {
+            vector<thread> workers;
+            for (unsigned int i = 0; i < numThreads; i++)
+            {
+                int yStart = i * height / numThreads;
+                int yEnd = (i + 1) * height / numThreads;
+                workers.push_back(thread(&Denoiser::FilterRows, this, cref(current), cref(variance), ref(next), ref(nextVariance),
+                                         step, yStart, yEnd));
+            }
+            for (unsigned int i = 0; i < numThreads; i++)
+            {
+                workers[i].join();
+            }
+        }
+        current.swap(next);
+        variance.swap(nextVariance);
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            int ind = y * width + x;
+            image.SetPixel(x, y, Modulate(current[ind], albedos[ind]));
+        }
+    }
+}
+
+// the filtered variance shrinks with every pass, which makes later passes stricter about color
+void Denoiser::FilterRows(const vector<Vector3>& in, const vector<Float>& inVariance, vector<Vector3>& out,
+                          vector<Float>& outVariance, int step, int yStart, int yEnd)
+{
+    Float invNormal = 1 / (normalSigma * normalSigma);
+
+    for (int y = yStart; y < yEnd; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            int ind = y * width + x;
+            Vector3 color = in[ind];
+            Float depth = depths[ind];
+
+            // misses just see the background, which isn't noisy
+            if (depth < 0)
+            {
+                out[ind] = color;
+                outVariance[ind] = inVariance[ind];
+                continue;
+            }
+
+            Vector3 normal = normals[ind];
+            Float lum = Luminance(color);
+            Float invColor = 1 / (colorSigma * sqrt(inVariance[ind]) + MIN_DEVIATION);
+            Float invDepth = 1 / (depthSigma * depth * step);
+            Vector3 sum = Vector3::zero;
+            Float sumVariance = 0;
+            Float totalWeight = 0;
+            for (int j = -2; j <= 2; j++)
+            {
+                int qy = y + j * step;
+                if (qy < 0 || qy >= height)
+                {
+                    continue;
+                }
+
+                for (int i = -2; i <= 2; i++)
+                {
+                    int qx = x + i * step;
+                    if (qx < 0 || qx >= width)
+                    {
+                        continue;
+                    }
+
+                    int q = qy * width + qx;
+                    if (depths[q] < 0)
+                    {
+                        continue;
+                    }
+
+                    Vector3 qColor = in[q];
+                    Float colorDist = fabs(Luminance(qColor) - lum);
+                    Float normalDist = (normals[q] - normal).sqrMagnitude();
+                    Float depthDist = fabs(depths[q] - depth);
+                    Float weight = KERNEL[i + 2] * KERNEL[j + 2] *
+                                   exp(-colorDist * invColor - normalDist * invNormal - depthDist * invDepth);
+
+                    sum += qColor * weight;
+                    sumVariance += inVariance[q] * weight * weight;
+                    totalWeight += weight;
+                }
+            }
+
+            // the center tap always has a weight, so this never divides by zero
+            out[ind] = sum / totalWeight;
+            outVariance[ind] = sumVariance / (totalWeight * totalWeight);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "math/Vector3.h"
+#include "Image.h"
+
+#include <vector>
+
+using namespace std;
+
+// what a camera ray's first hit looked like, averaged over a pixel's samples to guide the denoiser and
+// fill in the aov layers
+struct SurfaceFeatures
+{
+    Vector3 albedo;     // diffuse color of the material (or the background color for a miss)
+    Vector3 normal;     // shading normal, zero for a miss
+    Float depth;        // distance to the hit, -1 for a miss
+    int shapeID;        // -1 for a miss
+    int materialID;     // -1 for a miss
+
+    // the albedo is averaged over every sample, but the normal and depth only over the ones that hit
+    // something. ids can't be averaged so come from the first sample
+    static SurfaceFeatures Average(const SurfaceFeatures* samples, int count);
+};
+
+// Edge avoiding a-trous wavelet filter (Dammertz et al. 2010). Each pass blurs the image with a 5x5
+// b-spline kernel whose taps are spread 2^pass pixels apart, so a few passes cover a wide area cheaply.
+// Every tap is weighted by how similar its normal and depth are to the center pixel's, so the blur stops
+// at edges. Like SVGF, the luminance difference is measured against an estimate of the pixel's noise
+// (from the spread of its samples) rather than a fixed threshold, so real detail like shadow boundaries
+// survives while noise of any brightness gets smoothed. The color gets divided by the albedo before
+// filtering and multiplied back after, so textures stay sharp. Each pass is split into bands of rows
+// that run on their own threads.
+class Denoiser
+{
+    public:
+        Denoiser();
+
+        void SetDimensions(int width, int height);
+        // averages the features of a pixel's samples, and estimates its noise from their colors
+        void SetFeatures(int x, int y, const SurfaceFeatures* samples, const Vector3* colors, int count);
+
+        // filters the linear colors in image in place
+        void Denoise(Image& image, int passes, unsigned int threads);
+
+        // how quickly the weights fall off as the colors, normals and depths differ
+        Float colorSigma = 4;       // in standard deviations of the pixel's estimated noise
+        Float normalSigma = 0.2;
+        Float depthSigma = 0.02;    // relative to the center pixel's depth and the tap spacing
+
+    private:
+        int width;
+        int height;
+        vector<Vector3> albedos;
+        vector<Vector3> normals;
+        vector<Float> depths;
+        vector<Float> variances;    // of the pixel's demodulated luminance, -1 if it only had one sample
+
+        void FilterRows(const vector<Vector3>& in, const vector<Float>& inVariance, vector<Vector3>& out,
+                        vector<Float>& outVariance, int step, int yStart, int yEnd);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include "EnvironmentMap.h"
+
+// solid angle of a texel is about 4pi / resolution^2, this is the square root of the 4pi
+static const Float SQRT_4PI = 3.5449077018;
+
+EnvironmentMap::EnvironmentMap()
+{
+    resolution = 0;
+}
+
+// maps a direction onto the octahedron |x| + |y| + |z| = 1 and unfolds it into [0, 1]^2
+void EnvironmentMap::DirectionToOctahedral(Vector3 dir, Float& u, Float& v)
+{
+    Float l1 = fabs(dir.x) + fabs(dir.y) + fabs(dir.z);
+    Float px = dir.x / l1;
+    Float pz = dir.z / l1;
+
+    // fold the lower half out into the corners
+    if (dir.y < 0)
+    {
+        Float fx = (1 - fabs(pz)) * (px >= 0 ? 1 : -1);
+        Float fz = (1 - fabs(px)) * (pz >= 0 ? 1 : -1);
+        px = fx;
+        pz = fz;
+    }
+
+    u = px * 0.5 + 0.5;
+    v = pz * 0.5 + 0.5;
+}
+
+Vector3 EnvironmentMap::OctahedralToDirection(Float u, Float v)
+{
+    Float px = u * 2 - 1;
+    Float pz = v * 2 - 1;
+    Float py = 1 - fabs(px) - fabs(pz);
+
+    if (py < 0)
+    {
+        Float fx = (1 - fabs(pz)) * (px >= 0 ? 1 : -1);
+        Float fz = (1 - fabs(px)) * (pz >= 0 ? 1 : -1);
+        px = fx;
+        pz = fz;
+    }
+
+    return Vector3(px, py, pz).normalized();
+}
+
+// texels past an edge of the square wrap to the mirrored texel on the same edge, since the octahedron
+// is folded along those edges
+static Vector3 GetWrappedPixel(shared_ptr<Image>& level, int x, int y, int size)
+{
+    if (x < 0)
+    {
+        x = -x - 1;
+        y = size - 1 - y;
+    }
+    else if (x >= size)
+    {
+        x = 2 * size - 1 - x;
+        y = size - 1 - y;
+    }
+
+    if (y < 0)
+    {
+        y = -y - 1;
+        x = size - 1 - x;
+    }
+    else if (y >= size)
+    {
+        y = 2 * size - 1 - y;
+        x = size - 1 - x;
+    }
+
+    return level->GetPixel(x, y);
+}
+
+// resamples the lat-long image into the octahedral layout, then builds the mip chain and the
+// prefiltered roughness levels from it
+void EnvironmentMap::Build(shared_ptr<Image> latLong)
+{
+    levels.clear();
+    roughnessLevels.clear();
+
+    // use about as many texels as the source has, capped to keep the build quick
+    resolution = 16;
+    while (resolution * resolution < latLong->GetWidth() * latLong->GetHeight() && resolution < 2048)
+    {
+        resolution *= 2;
+    }
+
+    // filter the source over roughly the area of one of our texels
+    Float footprint = SQRT_4PI / resolution * 0.5 * M_1_PI;
+
+    shared_ptr<Image> base = make_shared<Image>(resolution, resolution, TEXEL_HALF);
+    for (int y = 0; y < resolution; y++)
+    {
+        for (int x = 0; x < resolution; x++)
+        {
+            Vector3 dir = OctahedralToDirection((x + 0.5) / resolution, (y + 0.5) / resolution);
+            Float u = atan2(dir.z, dir.x) * 0.5 * M_1_PI + 0.5;
+            Float v = acos(dir.y) * M_1_PI;
+            base->SetPixel(x, y, latLong->GetColorUV(u, v, footprint));
+        }
+    }
+    levels.push_back(base);
+
+    // 2x2 box filter down to a single texel, blocks never straddle a fold since the size is a power of 2
+    while (levels.back()->GetWidth() > 1)
+    {
+        shared_ptr<Image> prev = levels.back();
+        int size = prev->GetWidth() / 2;
+        shared_ptr<Image> level = make_shared<Image>(size, size, TEXEL_HALF);
+        for (int y = 0; y < size; y++)
+        {
+            for (int x = 0; x < size; x++)
+            {
+                Vector3 sum = prev->GetPixel(2 * x, 2 * y) + prev->GetPixel(2 * x + 1, 2 * y) +
+                              prev->GetPixel(2 * x, 2 * y + 1) + prev->GetPixel(2 * x + 1, 2 * y + 1);
+                level->SetPixel(x, y, sum * 0.25);
+            }
+        }
+        levels.push_back(level);
+    }
+
+    // rougher levels are blurrier so can get away with fewer texels
+    const int roughnessSizes[NUM_ROUGHNESS_LEVELS] = { 64, 32, 32, 16 };
+    for (int i = 0; i < NUM_ROUGHNESS_LEVELS; i++)
+    {
+        int size = min(roughnessSizes[i], resolution);
+        shared_ptr<Image> source = levels[0];
+        for (int j = 0; j < levels.size(); j++)
+        {
+            if (levels[j]->GetWidth() == size)
+            {
+                source = levels[j];
+                break;
+            }
+        }
+
+        shared_ptr<Image> target = make_shared<Image>(size, size, TEXEL_HALF);
+        Prefilter(source, target, (i + 1.0) / NUM_ROUGHNESS_LEVELS);
+        roughnessLevels.push_back(target);
+    }
+}
+
+// convolves the source with a phong lobe around each target texel's direction, using the exponent
+// 2 / roughness^2 - 2 that matches a beckmann distribution of the same roughness
+void EnvironmentMap::Prefilter(shared_ptr<Image> source, shared_ptr<Image> target, Float roughness)
+{
+    Float exponent = 2 / (roughness * roughness) - 2;
+    int sourceSize = source->GetWidth();
+    int targetSize = target->GetWidth();
+
+    // directions and solid angles of the source texels, the solid angle of a texel on the octahedron
+    // goes with 1 / |p|^3 where p is the texel's point on the octahedron
+    vector<Vector3> dirs(sourceSize * sourceSize);
+    vector<Float> weights(sourceSize * sourceSize);
+    vector<Vector3> colors(sourceSize * sourceSize);
+    for (int y = 0; y < sourceSize; y++)
+    {
+        for (int x = 0; x < sourceSize; x++)
+        {
+            int ind = y * sourceSize + x;
+            Vector3 dir = OctahedralToDirection((x + 0.5) / sourceSize, (y + 0.5) / sourceSize);
+            Float l1 = fabs(dir.x) + fabs(dir.y) + fabs(dir.z);
+            Float invLen = l1; // |p| = 1 / l1 since dir has unit length
+            dirs[ind] = dir;
+            weights[ind] = invLen * invLen * invLen;
+            colors[ind] = source->GetPixel(x, y);
+        }
+    }
+
+    for (int y = 0; y < targetSize; y++)
+    {
+        for (int x = 0; x < targetSize; x++)
+        {
+            Vector3 dir = OctahedralToDirection((x + 0.5) / targetSize, (y + 0.5) / targetSize);
+            Vector3 sum = Vector3::zero;
+            Float totalWeight = 0;
+            for (int i = 0; i < dirs.size(); i++)
+            {
+                Float cosTheta = dir.dot(dirs[i]);
+                if (cosTheta <= 0)
+                {
+                    continue;
+                }
+
+                Float weight = pow(cosTheta, exponent) * weights[i];
+                sum += colors[i] * weight;
+                totalWeight += weight;
+            }
+
+            target->SetPixel(x, y, totalWeight > 0 ? sum / totalWeight : Vector3::zero);
+        }
+    }
+}
+
+void EnvironmentMap::MoveToCache(shared_ptr<TextureCache> cache)
+{
+    for (int i = 0; i < levels.size(); i++)
+    {
+        levels[i]->MoveToCache(cache);
+    }
+    for (int i = 0; i < roughnessLevels.size(); i++)
+    {
+        roughnessLevels[i]->MoveToCache(cache);
+    }
+}
+
+size_t EnvironmentMap::GetMemoryUsage()
+{
+    size_t total = 0;
+    for (int i = 0; i < levels.size(); i++)
+    {
+        total += levels[i]->GetMemoryUsage();
+    }
+    for (int i = 0; i < roughnessLevels.size(); i++)
+    {
+        total += roughnessLevels[i]->GetMemoryUsage();
+    }
+    return total;
+}
+
+Vector3 EnvironmentMap::SampleBilinear(shared_ptr<Image> level, Float u, Float v)
+{
+    int size = level->GetWidth();
+    Float x = u * size - 0.5;
+    Float y = v * size - 0.5;
+    int x0 = (int) floor(x);
+    int y0 = (int) floor(y);
+    Float tx = x - x0;
+    Float ty = y - y0;
+
+    Vector3 bottom = GetWrappedPixel(level, x0, y0, size) * (1 - tx) + GetWrappedPixel(level, x0 + 1, y0, size) * tx;
+    Vector3 top = GetWrappedPixel(level, x0, y0 + 1, size) * (1 - tx) + GetWrappedPixel(level, x0 + 1, y0 + 1, size) * tx;
+    return bottom * (1 - ty) + top * ty;
+}
+
+Vector3 EnvironmentMap::SampleMip(Float u, Float v, Float angle)
+{
+    // pick the level where a texel covers about the ray's spread
+    Float level = log2(max(angle * resolution / SQRT_4PI, (Float) 1e-8));
+    if (!(level > 0))
+    {
+        return SampleBilinear(levels[0], u, v);
+    }
+
+    int numLevels = levels.size();
+    if (level >= numLevels - 1)
+    {
+        return SampleBilinear(levels.back(), u, v);
+    }
+
+    int lower = (int) level;
+    Float t = level - lower;
+    return SampleBilinear(levels[lower], u, v) * (1 - t) + SampleBilinear(levels[lower + 1], u, v) * t;
+}
+
+Vector3 EnvironmentMap::Sample(Vector3 dir, Float angle, Float roughness)
+{
+    Float u, v;
+    DirectionToOctahedral(dir, u, v);
+
+    if (roughness <= 0)
+    {
+        return SampleMip(u, v, angle);
+    }
+
+    // lerp between the two closest prefiltered levels, level i has roughness (i + 1) / NUM_ROUGHNESS_LEVELS
+    Float r = roughness * NUM_ROUGHNESS_LEVELS;
+    int lower = (int) r;
+    Float t = r - lower;
+    if (lower >= NUM_ROUGHNESS_LEVELS)
+    {
+        return SampleBilinear(roughnessLevels.back(), u, v);
+    }
+
+    Vector3 lowerCol = lower == 0 ? SampleMip(u, v, angle) : SampleBilinear(roughnessLevels[lower - 1], u, v);
+    Vector3 upperCol = SampleBilinear(roughnessLevels[lower], u, v);
+    return lowerCol * (1 - t) + upperCol * t;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef ENVIRONMENTMAP_H
+#define ENVIRONMENTMAP_H
+
+#include "math/Vector3.h"
+#include "Image.h"
+
+#include <vector>
+#include <memory>
+
+using namespace std;
+
+// The hdri resampled into an octahedral layout, so looking up a direction only takes a few adds and a
+// divide rather than the atan2 and acos of a lat-long lookup. The sphere is projected onto an octahedron
+// which is then unfolded into a square, with the upper half (y > 0) in the middle diamond and the lower
+// half folded out into the corners. Besides the regular mip chain, a few prefiltered levels are kept for
+// rough reflections, so a blurry reflection of the environment only takes a single lookup.
+class EnvironmentMap
+{
+    public:
+        static const int NUM_ROUGHNESS_LEVELS = 4;  // for roughness 0.25, 0.5, 0.75 and 1
+
+        EnvironmentMap();
+
+        void Build(shared_ptr<Image> latLong);
+        void MoveToCache(shared_ptr<TextureCache> cache);
+        size_t GetMemoryUsage();
+
+        // angle is the spread of the ray in radians (from its differentials), used to pick the mip level
+        Vector3 Sample(Vector3 dir, Float angle, Float roughness = 0);
+
+        static void DirectionToOctahedral(Vector3 dir, Float& u, Float& v);
+        static Vector3 OctahedralToDirection(Float u, Float v);
+
+    private:
+        int resolution;
+        vector<shared_ptr<Image>> levels;           // mip chain, level 0 is full resolution
+        vector<shared_ptr<Image>> roughnessLevels;
+
+        Vector3 SampleBilinear(shared_ptr<Image> level, Float u, Float v);
+        Vector3 SampleMip(Float u, Float v, Float angle);
+        void Prefilter(shared_ptr<Image> source, shared_ptr<Image> target, Float roughness);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,223 @@
+#include "Framebuffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+Framebuffer::Framebuffer()
+{
+    width = 0;
+    height = 0;
+}
+
+int Framebuffer::AddLayer(string name, string channels)
+{
+    Layer layer;
+    layer.name = name;
+    layer.channels = channels;
+    layer.values.assign((size_t) width * height * GetNumChannels(layer), 0);
+    layers.push_back(layer);
+    return layers.size() - 1;
+}
+
+int Framebuffer::FindLayer(string name)
+{
+    for (int i = 0; i < layers.size(); i++)
+    {
+        if (layers[i].name == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void Framebuffer::Clear()
+{
+    layers.clear();
+}
+
+void Framebuffer::SetDimensions(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    for (int i = 0; i < layers.size(); i++)
+    {
+        layers[i].values.assign((size_t) width * height * GetNumChannels(layers[i]), 0);
+    }
+}
+
+void Framebuffer::SetPixel(int layer, int x, int y, Vector3 value)
+{
+    Layer& l = layers[layer];
+    int numChannels = GetNumChannels(l);
+    float* values = &l.values[((size_t) y * width + x) * numChannels];
+    values[0] = value.x;
+    if (numChannels == 3)
+    {
+        values[1] = value.y;
+        values[2] = value.z;
+    }
+}
+
+void Framebuffer::SetPixel(int layer, int x, int y, Float value)
+{
+    Layer& l = layers[layer];
+    l.values[((size_t) y * width + x) * GetNumChannels(l)] = value;
+}
+
+Vector3 Framebuffer::GetPixel(int layer, int x, int y)
+{
+    Layer& l = layers[layer];
+    int numChannels = GetNumChannels(l);
+    const float* values = &l.values[((size_t) y * width + x) * numChannels];
+    if (numChannels == 3)
+    {
+        return Vector3(values[0], values[1], values[2]);
+    }
+    return Vector3(values[0], values[0], values[0]);
+}
+
+// exr is little endian no matter what the machine is
+static void WriteInt(vector<char>& out, uint32_t value, int bytes = 4)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        out.push_back((char) ((value >> (8 * i)) & 0xff));
+    }
+}
+
+static void WriteUInt64(vector<char>& out, uint64_t value)
+{
+    WriteInt(out, (uint32_t) value);
+    WriteInt(out, (uint32_t) (value >> 32));
+}
+
+static void WriteFloat(vector<char>& out, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    WriteInt(out, bits);
+}
+
+static void WriteString(vector<char>& out, const string& value)
+{
+    out.insert(out.end(), value.begin(), value.end());
+    out.push_back(0);
+}
+
+static void WriteAttribute(vector<char>& out, const string& name, const string& type, int size)
+{
+    WriteString(out, name);
+    WriteString(out, type);
+    WriteInt(out, size);
+}
+
+static void WriteBox(vector<char>& out, const string& name, int width, int height)
+{
+    WriteAttribute(out, name, "box2i", 16);
+    WriteInt(out, 0);
+    WriteInt(out, 0);
+    WriteInt(out, width - 1);
+    WriteInt(out, height - 1);
+}
+
+int Framebuffer::SaveToFileEXR(string fileName)
+{
+    // every channel of every layer, exr wants them sorted by name
+    struct Channel
+    {
+        string name;
+        int layer;
+        int offset;
+    };
+    vector<Channel> channels;
+    for (int i = 0; i < layers.size(); i++)
+    {
+        if (layers[i].channels.empty())
+        {
+            channels.push_back({ layers[i].name, i, 0 });
+            continue;
+        }
+        for (int c = 0; c < layers[i].channels.size(); c++)
+        {
+            string suffix(1, layers[i].channels[c]);
+            channels.push_back({ layers[i].name.empty() ? suffix : layers[i].name + "." + suffix, i, c });
+        }
+    }
+    sort(channels.begin(), channels.end(), [](const Channel& a, const Channel& b) { return a.name < b.name; });
+
+    vector<char> out;
+
+    // magic number and version 2, single part scanline file
+    WriteInt(out, 20000630);
+    WriteInt(out, 2);
+
+    int listSize = 1;
+    for (int i = 0; i < channels.size(); i++)
+    {
+        listSize += channels[i].name.size() + 1 + 16;
+    }
+    WriteAttribute(out, "channels", "chlist", listSize);
+    for (int i = 0; i < channels.size(); i++)
+    {
+        WriteString(out, channels[i].name);
+        WriteInt(out, 2);       // float
+        WriteInt(out, 0);       // pLinear and reserved bytes
+        WriteInt(out, 1);       // x and y sampling
+        WriteInt(out, 1);
+    }
+    out.push_back(0);
+
+    WriteAttribute(out, "compression", "compression", 1);
+    out.push_back(0);
+    WriteBox(out, "dataWindow", width, height);
+    WriteBox(out, "displayWindow", width, height);
+    WriteAttribute(out, "lineOrder", "lineOrder", 1);
+    out.push_back(0);
+    WriteAttribute(out, "pixelAspectRatio", "float", 4);
+    WriteFloat(out, 1);
+    WriteAttribute(out, "screenWindowCenter", "v2f", 8);
+    WriteFloat(out, 0);
+    WriteFloat(out, 0);
+    WriteAttribute(out, "screenWindowWidth", "float", 4);
+    WriteFloat(out, 1);
+    out.push_back(0);
+
+    // offset table, each uncompressed chunk holds one scanline
+    uint64_t lineBytes = (uint64_t) width * channels.size() * 4;
+    uint64_t firstLine = out.size() + (uint64_t) height * 8;
+    for (int y = 0; y < height; y++)
+    {
+        WriteUInt64(out, firstLine + y * (8 + lineBytes));
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        WriteInt(out, y);
+        WriteInt(out, lineBytes);
+
+        // exr's first line is the top of the image
+        int row = height - 1 - y;
+        for (int i = 0; i < channels.size(); i++)
+        {
+            Layer& layer = layers[channels[i].layer];
+            int numChannels = GetNumChannels(layer);
+            for (int x = 0; x < width; x++)
+            {
+                WriteFloat(out, layer.values[((size_t) row * width + x) * numChannels + channels[i].offset]);
+            }
+        }
+    }
+
+    ofstream file(fileName.c_str(), ios::binary);
+    if (!file.is_open())
+    {
+        cout << "Error: Could not open file " << fileName << endl;
+        return 1;
+    }
+
+    file.write(out.data(), out.size());
+    file.close();
+    return 0;
+}
\ No newline at end of file
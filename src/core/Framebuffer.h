@@ -0,0 +1,54 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "math/Vector3.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Named layers of per pixel values the renderer fills in alongside the image (depth, normals, ids and
+// so on), so every pass needed for compositing comes out of a single render. Each layer has one or
+// three float channels and they all get written to one multi-channel OpenEXR file.
+class Framebuffer
+{
+    public:
+        Framebuffer();
+
+        // channels names the layer's channels, e.g. "RGB" or "XYZ", or is empty for a single channel layer.
+        // returns the layer's index
+        int AddLayer(string name, string channels = "");
+        int FindLayer(string name);     // -1 if there isn't one
+        int GetNumLayers() { return layers.size(); }
+        void Clear();
+
+        void SetDimensions(int width, int height);
+        int GetWidth() { return width; }
+        int GetHeight() { return height; }
+
+        void SetPixel(int layer, int x, int y, Vector3 value);
+        void SetPixel(int layer, int x, int y, Float value);
+        Vector3 GetPixel(int layer, int x, int y);
+
+        // uncompressed scanline exr with 32 bit float channels, y is flipped like the ppm output
+        int SaveToFileEXR(string fileName);
+
+    private:
+        struct Layer
+        {
+            string name;
+            string channels;
+            vector<float> values;   // interleaved, channels per pixel
+        };
+
+        int width;
+        int height;
+        vector<Layer> layers;
+
+        int GetNumChannels(const Layer& layer) { return layer.channels.empty() ? 1 : layer.channels.size(); }
+};
+
+#endif
\ No newline at end of file
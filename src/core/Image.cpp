@@ -1,52 +1,83 @@
 #include "Image.h"
+#include "RenderStats.h"
 
 Image::Image()
 {
     width = 0;
     height = 0;
-    pixels = nullptr;
 }
 
-Image::Image(int width, int height)
+Image::Image(int width, int height, TexelFormat format)
 {
     this->width = width;
     this->height = height;
-    pixels = new Vector3[width * height];
+    pixels.Allocate(width, height, 3, format);
 }
 
 Image::~Image()
 {
-    if (pixels != nullptr)
-    {
-        delete[] pixels;
-    }
 }
 
 
-void Image::SetDimensions(int width, int height)
+void Image::SetDimensions(int width, int height, TexelFormat format)
 {
     this->width = width;
     this->height = height;
-    if (pixels != nullptr)
+    pixels.Allocate(width, height, 3, format);
+    mipmaps.clear();
+    cache = nullptr;
+}
+
+size_t Image::GetMemoryUsage()
+{
+    size_t total = pixels.GetMemoryUsage();
+    for (int i = 0; i < mipmaps.size(); i++)
+    {
+        total += mipmaps[i]->GetMemoryUsage();
+    }
+    return total;
+}
+
+void Image::MoveToCache(shared_ptr<TextureCache> cache)
+{
+    if (this->cache != nullptr)
     {
-        delete[] pixels;
+        return;
+    }
+
+    firstTile = cache->AddTexels(pixels);
+    pixels.ReleaseTexels();
+    this->cache = cache;
+
+    for (int i = 0; i < mipmaps.size(); i++)
+    {
+        mipmaps[i]->MoveToCache(cache);
     }
-    pixels = new Vector3[width * height];
 }
 
 void Image::SetPixel(int x, int y, Vector3 color)
 {
-    if (y * width + x < width * height)
+    if (cache == nullptr && x >= 0 && x < width && y >= 0 && y < height)
     {
-        pixels[y * width + x] = color;
+        float values[3] = { (float) color.x, (float) color.y, (float) color.z };
+        pixels.SetTexel(x, y, values);
     }
 }
 
 Vector3 Image::GetPixel(int x, int y)
 {
-    if (y * width + x < width * height)
+    if (x >= 0 && x < width && y >= 0 && y < height)
     {
-        return pixels[y * width + x];
+        float values[3];
+        if (cache != nullptr)
+        {
+            pixels.DecodeTexel(cache->GetTile(firstTile + pixels.GetBlockIndex(x, y)), x, y, values);
+        }
+        else
+        {
+            pixels.GetTexel(x, y, values);
+        }
+        return Vector3(values[0], values[1], values[2]);
     }
     else
     {
@@ -86,8 +117,8 @@ Vector3 Image::GetColorUV(Float u, Float v)
     y1 = y1 % height;
     y2 = y2 % height;
 
-    Float t = u - (int)u; // lerp factor for u
-    Float s = v - (int)v; // lerp factor for v
+    Float t = u * width - (int)(u * width); // lerp factor for u
+    Float s = v * height - (int)(v * height); // lerp factor for v
 
     // get color of 4 closest pixels
     Vector3 p1 = GetPixel(x1, y1);
@@ -103,6 +134,100 @@ Vector3 Image::GetColorUV(Float u, Float v)
     return top * s + bottom * (1 - s);
 }
 
+Vector3 Image::GetColorUV(Float u, Float v, Float footprint)
+{
+    // pick the mip level where the footprint covers about one texel
+    Float level = log2(max(footprint * max(width, height), (Float) 1e-8));
+    if (!(level > 0) || mipmaps.size() == 0)
+    {
+        return GetColorUV(u, v);
+    }
+
+    int numLevels = mipmaps.size();
+    if (level >= numLevels)
+    {
+        return mipmaps.back()->GetColorUV(u, v);
+    }
+
+    // lerp between the two closest levels
+    int lower = (int) level;
+    Float t = level - lower;
+    Vector3 lowerCol = lower == 0 ? GetColorUV(u, v) : mipmaps[lower - 1]->GetColorUV(u, v);
+    Vector3 upperCol = mipmaps[lower]->GetColorUV(u, v);
+
+    return lowerCol * (1 - t) + upperCol * t;
+}
+
+// takes a few trilinear samples along the longer axis of the footprint, with the mip level picked from the
+// shorter axis, so surfaces at grazing angles don't get blurred as much as a single trilinear lookup would
+Vector3 Image::GetColorUV(UV uv, UV duvdx, UV duvdy)
+{
+    const int maxAnisotropy = 8;
+
+    // measure the axes in texels so non-square textures get the right level
+    Float lenX = sqrt(duvdx.u * duvdx.u * width * width + duvdx.v * duvdx.v * height * height);
+    Float lenY = sqrt(duvdy.u * duvdy.u * width * width + duvdy.v * duvdy.v * height * height);
+    UV majorAxis = lenX > lenY ? duvdx : duvdy;
+    Float majorLen = max(lenX, lenY);
+    Float minorLen = min(lenX, lenY);
+
+    if (!(majorLen > 1)) // also catches nan
+    {
+        return GetColorUV(uv.u, uv.v);
+    }
+
+    // clamp the eccentricity, otherwise thin footprints would need a huge number of samples
+    minorLen = max(minorLen, majorLen / maxAnisotropy);
+    int numSamples = min((int) ceil(majorLen / minorLen), maxAnisotropy);
+    Float footprint = minorLen / max(width, height);
+
+    if (numSamples <= 1)
+    {
+        return GetColorUV(uv.u, uv.v, footprint);
+    }
+
+    Vector3 col = Vector3::zero;
+    for (int i = 0; i < numSamples; i++)
+    {
+        Float offset = (i + 0.5) / numSamples - 0.5;
+        UV sampleUV = uv + majorAxis * offset;
+        col += GetColorUV(sampleUV.u, sampleUV.v, footprint);
+    }
+
+    return col / numSamples;
+}
+
+// builds the mip pyramid by repeatedly averaging 2x2 blocks of the previous level
+void Image::GenerateMipmaps()
+{
+    ScopedPhaseTimer timer(PHASE_TEXTURES);
+    mipmaps.clear();
+
+    Image* prev = this;
+    while (prev->width > 1 || prev->height > 1)
+    {
+        int newWidth = max(1, prev->width / 2);
+        int newHeight = max(1, prev->height / 2);
+        shared_ptr<Image> level = make_shared<Image>(newWidth, newHeight, GetFormat());
+
+        for (int y = 0; y < newHeight; y++)
+        {
+            int y1 = min(2 * y, prev->height - 1);
+            int y2 = min(2 * y + 1, prev->height - 1);
+            for (int x = 0; x < newWidth; x++)
+            {
+                int x1 = min(2 * x, prev->width - 1);
+                int x2 = min(2 * x + 1, prev->width - 1);
+                Vector3 sum = prev->GetPixel(x1, y1) + prev->GetPixel(x2, y1) + prev->GetPixel(x1, y2) + prev->GetPixel(x2, y2);
+                level->SetPixel(x, y, sum * 0.25);
+            }
+        }
+
+        mipmaps.push_back(level);
+        prev = level.get();
+    }
+}
+
 Vector3 Image::GetBumpUV(Float u, Float v)
 {
     // first read in color
@@ -137,17 +262,15 @@ int Image::SaveToFilePPM(string fileName)
         int x;
         for (x = 0; x < width - 2; x+=3)
         {
-            int ind = y * width + x;
-            oss << pixels[ind].PrintRGB() << " ";
-            oss << pixels[ind + 1].PrintRGB() << " ";
-            oss << pixels[ind + 2].PrintRGB() << endl;
+            oss << GetPixel(x, y).PrintRGB() << " ";
+            oss << GetPixel(x + 1, y).PrintRGB() << " ";
+            oss << GetPixel(x + 2, y).PrintRGB() << endl;
         }
 
         // write remaining pixels
         for (; x < width; x++)
         {
-            int ind = y * width + x;
-            oss << pixels[ind].PrintRGB() << " ";
+            oss << GetPixel(x, y).PrintRGB() << " ";
         }
         oss << endl;
     }
@@ -168,6 +291,7 @@ int Image::SaveToFilePPM(string fileName)
 
 int Image::LoadFromFilePPM(string fileName, Image& image)
 {
+    ScopedPhaseTimer timer(PHASE_TEXTURES);
     ifstream file;
     string line, token;
     vector<string> args;
@@ -260,8 +384,8 @@ int Image::LoadFromFilePPM(string fileName, Image& image)
         return 1;
     }
 
-    // read pixels
-    image.SetDimensions(width, height);
+    // read pixels, 8 bit ppms can be stored exactly in 8 bits
+    image.SetDimensions(width, height, max == 255 ? TEXEL_U8 : TEXEL_FLOAT);
     for (int y = 0; y < height; y++)
     {
         for (int x = 0; x < width; x++)
@@ -272,8 +396,7 @@ int Image::LoadFromFilePPM(string fileName, Image& image)
                 cout << "Error: Image " << fileName << " has invalid pixel data" << endl;
                 return 1;
             }
-            int ind = y * width + x;
-            image[ind] = Vector3(r / max, g / max, b / max);
+            image.SetPixel(x, y, Vector3(r / max, g / max, b / max));
         }
     }
 
@@ -283,6 +406,7 @@ int Image::LoadFromFilePPM(string fileName, Image& image)
 
 int Image::LoadFromFilePPM(string fileName, shared_ptr<Image> image)
 {
+    ScopedPhaseTimer timer(PHASE_TEXTURES);
     ifstream file;
     string line, token;
     vector<string> args;
@@ -375,8 +499,8 @@ int Image::LoadFromFilePPM(string fileName, shared_ptr<Image> image)
         return 1;
     }
 
-    // read pixels
-    image->SetDimensions(width, height);
+    // read pixels, 8 bit ppms can be stored exactly in 8 bits
+    image->SetDimensions(width, height, max == 255 ? TEXEL_U8 : TEXEL_FLOAT);
     for (int y = 0; y < height; y++)
     {
         for (int x = 0; x < width; x++)
@@ -397,16 +521,36 @@ int Image::LoadFromFilePPM(string fileName, shared_ptr<Image> image)
 
 int Image::LoadFromFile(string filename, shared_ptr<Image> image)
 {
-    // load rbg image into pixels using stb_image library
-    stbi_ldr_to_hdr_gamma(1.0f);
-    float* data = stbi_loadf(filename.c_str(), &image->width, &image->height, nullptr, 3);
+    ScopedPhaseTimer timer(PHASE_TEXTURES);
+
+    // load rbg image into pixels using stb_image library, keeping the precision of the file
+    // (8 bit for regular images, 16 bit pngs as halfs, and floats for hdr images)
+    int width, height;
+    void* data;
+    TexelFormat format;
+    if (stbi_is_hdr(filename.c_str()))
+    {
+        data = stbi_loadf(filename.c_str(), &width, &height, nullptr, 3);
+        format = TEXEL_FLOAT;
+    }
+    else if (stbi_is_16_bit(filename.c_str()))
+    {
+        data = stbi_load_16(filename.c_str(), &width, &height, nullptr, 3);
+        format = TEXEL_HALF;
+    }
+    else
+    {
+        data = stbi_load(filename.c_str(), &width, &height, nullptr, 3);
+        format = TEXEL_U8;
+    }
+
     if (!data)
     {
         cout << "Error: Could not load image " << filename << endl;
         return 1;
     }
 
-    image->SetDimensions(image->width, image->height);
+    image->SetDimensions(width, height, format);
 
     // flip y axis
     int index = 0;
@@ -414,7 +558,23 @@ int Image::LoadFromFile(string filename, shared_ptr<Image> image)
     {
         for (int x = 0; x < image->width; x++) // (int x = image->width - 1; x >= 0; x--) // 
         {
-            image->SetPixel(x, y, Vector3(data[index], data[index + 1], data[index + 2]));
+            Vector3 color;
+            if (format == TEXEL_FLOAT)
+            {
+                float* floats = (float*) data;
+                color = Vector3(floats[index], floats[index + 1], floats[index + 2]);
+            }
+            else if (format == TEXEL_HALF)
+            {
+                unsigned short* shorts = (unsigned short*) data;
+                color = Vector3(shorts[index] / 65535.0f, shorts[index + 1] / 65535.0f, shorts[index + 2] / 65535.0f);
+            }
+            else
+            {
+                unsigned char* bytes = (unsigned char*) data;
+                color = Vector3(bytes[index] / 255.0f, bytes[index + 1] / 255.0f, bytes[index + 2] / 255.0f);
+            }
+            image->SetPixel(x, y, color);
             index += 3;
         }
     }
@@ -423,16 +583,4 @@ int Image::LoadFromFile(string filename, shared_ptr<Image> image)
 
     image->filepath = filename;
     return 0;
-}
-
-Vector3& Image::operator[](int ind)
-{
-    if (ind > 0 && ind < width * height)
-    {
-        return pixels[ind];
-    }
-    else
-    {
-        return pixels[0];
-    }
-}
+}
\ No newline at end of file
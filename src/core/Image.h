@@ -2,6 +2,8 @@
 #define IMAGE_H
 
 #include "math/Vector3.h"
+#include "TexelBuffer.h"
+#include "TextureCache.h"
 #include "ext/stb_image.h"
 
 #include <iostream>
@@ -19,14 +21,24 @@ class Image
         string filepath;
 
         Image();
-        Image(int width, int height);
+        Image(int width, int height, TexelFormat format = TEXEL_FLOAT);
         ~Image();
 
-        void SetDimensions(int width, int height);
+        void SetDimensions(int width, int height, TexelFormat format = TEXEL_FLOAT);
+        int GetWidth() { return width; }
+        int GetHeight() { return height; }
+        TexelFormat GetFormat() { return pixels.GetFormat(); }
+        size_t GetMemoryUsage();                // bytes used by the texels, including mip levels
+        void MoveToCache(shared_ptr<TextureCache> cache);   // pages the texels (and mip levels) out to the cache
 
         void SetPixel(int x, int y, Vector3 color);
         Vector3 GetPixel(int x, int y);
         Vector3 GetColorUV(Float u, Float v);
+        Vector3 GetColorUV(Float u, Float v, Float footprint);   // trilinear lookup for a filter width in uv space
+        Vector3 GetColorUV(UV uv, UV duvdx, UV duvdy);           // anisotropic lookup using the uv screen space derivatives
+
+        void GenerateMipmaps();
+        int GetNumMipLevels() { return mipmaps.size() + 1; }
         Vector3 GetBumpUV(Float u, Float v);
 
         int SaveToFilePPM(string fileName);
@@ -35,12 +47,13 @@ class Image
         static int LoadFromFilePPM(string fileName, shared_ptr<Image> image);
         static int LoadFromFile(string fileName, shared_ptr<Image> image); // for jpg and png using stb_image
 
-        Vector3& operator[](int);
-
     private:
         int width;
         int height;
-        Vector3* pixels;
+        TexelBuffer pixels;
+        shared_ptr<TextureCache> cache;     // set once the texels live in the texture cache, read only after that
+        int firstTile = 0;
+        vector<shared_ptr<Image>> mipmaps; // levels 1 and up, level 0 is this image
 
 };
 
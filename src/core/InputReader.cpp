@@ -393,6 +393,7 @@ void InputReader::getTextures(json material, Scene& scene)
 		if (material.find("roughnessFactor") != material.end())
 		{
 			Float n = material["roughnessFactor"];
+			mat.SetRoughness(n);
 			n = 100 * (n - 1) * (n - 1);
 			mat.SetSpecFalloff(n);
 		}
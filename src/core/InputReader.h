@@ -8,6 +8,7 @@
 #include "lights/DirectionalLight.h"
 #include "lights/PointLight.h"
 #include "lights/SpotLight.h"
+#include "lights/AreaLight.h"
 #include "ext/json.h"
 #include "math/Transform.h"
 
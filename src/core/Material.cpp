@@ -43,6 +43,7 @@ Material::Material(const Material& other)
     this->normal_strength = other.normal_strength;
     this->alpha = other.alpha;
     this->ior = other.ior;
+    this->roughness = other.roughness;
 }
 
 Material& Material::operator=(const Material& other) 
@@ -62,6 +63,7 @@ Material& Material::operator=(const Material& other)
     this->normal_strength = other.normal_strength;
     this->alpha = other.alpha;
     this->ior = other.ior;
+    this->roughness = other.roughness;
     return *this;
 }
 
@@ -105,6 +107,11 @@ void Material::SetIOR(Float ior)
     this->ior = ior;
 }
 
+void Material::SetRoughness(Float roughness)
+{
+    this->roughness = roughness < 0 ? 0 : (roughness > 1 ? 1 : roughness);
+}
+
 void Material::SetNormalStrength(Float normal_strength)
 {
     this->normal_strength = normal_strength;
@@ -158,6 +165,11 @@ Float Material::GetSpecFalloff()
     return spec_falloff;
 }
 
+Float Material::GetRoughness()
+{
+    return roughness;
+}
+
 Float Material::GetAlpha()
 {
     return alpha;
@@ -173,7 +185,7 @@ Float Material::GetNormalStrength()
     return normal_strength;
 }
 
-Vector3 Material::CalculateNormal(RayHit& hit, vector<shared_ptr<Image>>& bumpMaps)
+Vector3 Material::CalculateNormal(RayHit& hit, vector<shared_ptr<Image>>& bumpMaps) const
 {
     if (!has_bump_map)
     {
@@ -183,7 +195,7 @@ Vector3 Material::CalculateNormal(RayHit& hit, vector<shared_ptr<Image>>& bumpMa
     Vector3 normal = hit.normal;
     Vector3 tangent = hit.tangent;
     Vector3 bitangent = hit.bitangent;
-    Vector3 map_col = bumpMaps[bump_map_index]->GetColorUV(hit.uv.u, hit.uv.v);
+    Vector3 map_col = bumpMaps[bump_map_index]->GetColorUV(hit.uv, hit.duvdx, hit.duvdy);
     Vector3 bump_normal = map_col * 2.0 - Vector3(1.0, 1.0, 1.0);
     bump_normal.x *= normal_strength;
     bump_normal.y *= normal_strength;
@@ -199,87 +211,71 @@ Vector3 Material::CalculateNormal(RayHit& hit, vector<shared_ptr<Image>>& bumpMa
     return new_normal;
 }
 
-// calculated using the Phong model
-Vector3 Material::GetColor(RayHit& hitInfo, vector<shared_ptr<Image>>& textures, vector<shared_ptr<Image>>& bumpMaps, vector<shared_ptr<BWImage>>& specMaps, 
-                           Float diffuseAmt, Float specularAmt, Vector3 lightColor)
+MaterialSample Material::Sample(RayHit& hitInfo, vector<shared_ptr<Image>>& textures, vector<shared_ptr<BWImage>>& specMaps) const
 {
+    MaterialSample sample;
+    sample.diffuse = diffuse;
+    sample.specFalloff = spec_falloff;
+
+    if (has_texture)
+    {
+        sample.diffuse = textures[texture_index]->GetColorUV(hitInfo.uv, hitInfo.duvdx, hitInfo.duvdy);
+    }
     if (has_spec_map)
     {
-        Float n = specMaps[spec_map_index]->GetColorUV(hitInfo.uv.u, hitInfo.uv.v);
-        spec_falloff = 100 * (1 - n) * (1 - n);
+        Float n = specMaps[spec_map_index]->GetColorUV(hitInfo.uv, hitInfo.duvdx, hitInfo.duvdy);
+        sample.specFalloff = 100 * (1 - n) * (1 - n);
     }
 
+    return sample;
+}
+
+// calculated using the Phong model
+Vector3 Material::GetColor(const MaterialSample& sample, Float diffuseAmt, Float specularAmt, Vector3 lightColor) const
+{
     diffuseAmt = diffuseAmt < 0.0 ? 0.0 : diffuseAmt;
     specularAmt = specularAmt < 0.0 ? 0.0 : specularAmt;
-    specularAmt = pow(specularAmt, spec_falloff);
+    specularAmt = SpecularPow(specularAmt, sample.specFalloff);
 
-    Vector3 diffCol = diffuse;
-
-    if (has_texture)
-    {
-        diffCol = textures[texture_index]->GetColorUV(hitInfo.uv.u, hitInfo.uv.v);
-    }
-
-    Vector3 col =  k_diffuse * diffCol * diffuseAmt + k_specular * specular * specularAmt;
+    Vector3 col =  k_diffuse * sample.diffuse * diffuseAmt + k_specular * specular * specularAmt;
     col = col * lightColor; // scale diffuse/specular color by light color
     col += k_ambient * diffuse; // add ambient
 
     return col;
 }
 
-Vector3 Material::GetColorNoAmbient(RayHit& hitInfo, vector<shared_ptr<Image>>& textures, vector<shared_ptr<Image>>& bumpMaps, vector<shared_ptr<BWImage>>& specMaps,
-                                    Float diffuseAmt, Float specularAmt, Vector3 lightColor, Vector3& diffuse, Vector3& specular)
+Vector3 Material::GetColorNoAmbient(const MaterialSample& sample, Float diffuseAmt, Float specularAmt, Vector3 lightColor, Vector3& diffuse, Vector3& specular) const
 {
-    if (has_spec_map)
-    {
-        Float n = specMaps[spec_map_index]->GetColorUV(hitInfo.uv.u, hitInfo.uv.v);
-        spec_falloff = 100 * (1 - n) * (1 - n);
-    }
-
     diffuseAmt = diffuseAmt < 0.0 ? 0.0 : diffuseAmt;
     specularAmt = specularAmt < 0.0 ? 0.0 : specularAmt;
-    specularAmt = pow(specularAmt, spec_falloff);
-
-    Vector3 diffCol = this->diffuse;
+    specularAmt = SpecularPow(specularAmt, sample.specFalloff);
 
-    if (has_texture)
-    {
-        diffCol = textures[texture_index]->GetColorUV(hitInfo.uv.u, hitInfo.uv.v);
-    }
-    
-    diffuse = k_diffuse * diffCol * diffuseAmt * lightColor;
+    diffuse = k_diffuse * sample.diffuse * diffuseAmt * lightColor;
     specular = k_specular * this->specular * specularAmt * lightColor;
 
     return diffuse + specular;
 }
 
-Vector3 Material::GetAmbient()
+Vector3 Material::GetAmbient() const
 {
     return k_ambient * diffuse;
 }
 
-Vector3 Material::GetUnlit(RayHit& hitInfo, vector<shared_ptr<Image>>& textures, vector<shared_ptr<Image>>& bumpMaps)
+Vector3 Material::GetAmbient(const MaterialSample& sample) const
 {
-    Vector3 diffCol = diffuse;
-
-    if (has_texture)
-    {
-        diffCol = textures[texture_index]->GetColorUV(hitInfo.uv.u, hitInfo.uv.v);
-    }
-
-    return diffCol;
+    return k_ambient * sample.diffuse;
 }
 
-Vector3 Material::GetAmbient(RayHit& hitInfo, vector<shared_ptr<Image>>& textures, vector<shared_ptr<Image>>& bumpMaps)
+Vector3 Material::GetUnlit(RayHit& hitInfo, vector<shared_ptr<Image>>& textures) const
 {
     Vector3 diffCol = diffuse;
 
     if (has_texture)
     {
-        diffCol = textures[texture_index]->GetColorUV(hitInfo.uv.u, hitInfo.uv.v);
+        diffCol = textures[texture_index]->GetColorUV(hitInfo.uv, hitInfo.duvdx, hitInfo.duvdy);
     }
 
-    return k_ambient * diffCol;
+    return diffCol;
 }
 
 int Material::GetTexture()
@@ -2,6 +2,7 @@
 #define MATERIAL_H
 
 #include "math/Vector3.h"
+#include "math/FastMath.h"
 #include "Ray.h"
 #include "Image.h"
 #include "BWImage.h"
@@ -9,6 +10,14 @@
 #include <vector>
 #include <memory>
 
+// the parts of a material that come from its textures, looked up once per hit. keeping them out of the
+// material means a material never changes while rendering, so threads can share it
+struct MaterialSample
+{
+    Vector3 diffuse;        // texture color, or the material's diffuse color if it has no texture
+    Float specFalloff;      // from the spec map, or the material's spec_falloff if it has none
+};
+
 struct Material
 {
     public:
@@ -29,6 +38,7 @@ struct Material
         void SetSpecMap(int tex_ind);
         void SetAlpha(Float alpha);
         void SetIOR(Float ior);
+        void SetRoughness(Float roughness);
 
         Vector3 GetDiffuse();
         Vector3 GetSpecular();
@@ -39,18 +49,19 @@ struct Material
         Float GetNormalStrength();
         Float GetAlpha();
         Float GetIOR();
+        Float GetRoughness();
         int GetTexture();
         int GetBumpMap();
         int GetSpecMap();
 
-        Vector3 CalculateNormal(RayHit& hitInfo, vector<shared_ptr<Image>>& bumpMaps);
-        Vector3 GetColor(RayHit& hitInfo, vector<shared_ptr<Image>>& textures, vector<shared_ptr<Image>>& bumpMaps, vector<shared_ptr<BWImage>>& specMaps,
-                         Float diffuseAmt, Float specularAmt, Vector3 LightColor);
-        Vector3 GetColorNoAmbient(RayHit& hitInfo, vector<shared_ptr<Image>>& textures, vector<shared_ptr<Image>>& bumpMaps, vector<shared_ptr<BWImage>>& specMaps, 
-                                  Float diffuseAmt, Float specularAmt, Vector3 LightColor, Vector3& diffuse, Vector3& specular);
-        Vector3 GetAmbient();
-        Vector3 GetUnlit(RayHit& hitInfo, vector<shared_ptr<Image>>& textures, vector<shared_ptr<Image>>& bumpMaps);
-        Vector3 GetAmbient(RayHit& hitInfo, vector<shared_ptr<Image>>& textures, vector<shared_ptr<Image>>& bumpMaps);
+        // none of these change the material, so they're safe to call from any number of threads
+        Vector3 CalculateNormal(RayHit& hitInfo, vector<shared_ptr<Image>>& bumpMaps) const;
+        MaterialSample Sample(RayHit& hitInfo, vector<shared_ptr<Image>>& textures, vector<shared_ptr<BWImage>>& specMaps) const;
+        Vector3 GetColor(const MaterialSample& sample, Float diffuseAmt, Float specularAmt, Vector3 LightColor) const;
+        Vector3 GetColorNoAmbient(const MaterialSample& sample, Float diffuseAmt, Float specularAmt, Vector3 LightColor, Vector3& diffuse, Vector3& specular) const;
+        Vector3 GetAmbient() const;
+        Vector3 GetAmbient(const MaterialSample& sample) const;
+        Vector3 GetUnlit(RayHit& hitInfo, vector<shared_ptr<Image>>& textures) const;
 
 
     private:
@@ -64,6 +75,7 @@ struct Material
         Float normal_strength;
         Float alpha; // opacity of each channel
         Float ior; // index of refraction
+        Float roughness = 0; // blurs reflections of the environment, 0 is a perfect mirror and 1 is fully rough
 
         bool has_texture = false;
         bool has_bump_map = false;
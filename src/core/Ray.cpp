@@ -12,4 +12,162 @@ Ray::Ray(Vector3 origin, Vector3 direction, Float ior)
     this->origin = origin;
     this->direction = direction.normalized();
     iors.push_back(ior);
+}
+
+// past the max size the outermost material gets forgotten, there's little point nesting that deep
+void IORStack::push_back(Float ior)
+{
+    if (count == MAX_SIZE)
+    {
+        for (int i = 1; i < MAX_SIZE; i++)
+        {
+            values[i - 1] = values[i];
+        }
+        count--;
+    }
+    values[count++] = ior;
+}
+
+// used to shrink the differentials when taking multiple samples per pixel
+void Ray::ScaleDifferentials(Float scale)
+{
+    rxOrigin = origin + (rxOrigin - origin) * scale;
+    ryOrigin = origin + (ryOrigin - origin) * scale;
+    rxDirection = direction + (rxDirection - direction) * scale;
+    ryDirection = direction + (ryDirection - direction) * scale;
+}
+
+static Float GetComponent(Vector3& v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// solves the 2x2 system [a00 a01; a10 a11] * x = b for x, returns false if it's singular
+static bool SolveLinearSystem2x2(Float a00, Float a01, Float a10, Float a11, Float b0, Float b1, Float& x0, Float& x1)
+{
+    Float det = a00 * a11 - a01 * a10;
+    if (abs(det) < 1e-10)
+    {
+        return false;
+    }
+
+    x0 = (a11 * b0 - a01 * b1) / det;
+    x1 = (a00 * b1 - a10 * b0) / det;
+    return !(isnan(x0) || isnan(x1));
+}
+
+// finds how far the hit point moves in world and uv space when moving one pixel over, following pbrt's approach:
+// https://pbr-book.org/3ed-2018/Texture/Sampling_and_Antialiasing#FindingtheTextureSamplingRate
+void RayHit::ComputeDifferentials(Ray& ray)
+{
+    duvdx = UV(0, 0);
+    duvdy = UV(0, 0);
+    dpdx = dpdy = Vector3::zero;
+
+    if (!ray.hasDifferentials)
+    {
+        return;
+    }
+
+    // intersect the offset rays with the tangent plane of the hit
+    Float d = normal.dot(position);
+    Float denomX = normal.dot(ray.rxDirection);
+    Float denomY = normal.dot(ray.ryDirection);
+    if (denomX == 0 || denomY == 0)
+    {
+        return;
+    }
+
+    Float tx = -(normal.dot(ray.rxOrigin) - d) / denomX;
+    Float ty = -(normal.dot(ray.ryOrigin) - d) / denomY;
+    if (isinf(tx) || isnan(tx) || isinf(ty) || isnan(ty))
+    {
+        return;
+    }
+
+    Vector3 px = ray.rxOrigin + ray.rxDirection * tx;
+    Vector3 py = ray.ryOrigin + ray.ryDirection * ty;
+    dpdx = px - position;
+    dpdy = py - position;
+
+    // project onto the two axes the normal is least aligned with so the system isn't degenerate
+    int axis0, axis1;
+    if (abs(normal.x) > abs(normal.y) && abs(normal.x) > abs(normal.z))
+    {
+        axis0 = 1;
+        axis1 = 2;
+    }
+    else if (abs(normal.y) > abs(normal.z))
+    {
+        axis0 = 0;
+        axis1 = 2;
+    }
+    else
+    {
+        axis0 = 0;
+        axis1 = 1;
+    }
+
+    Float a00 = GetComponent(dpdu, axis0), a01 = GetComponent(dpdv, axis0);
+    Float a10 = GetComponent(dpdu, axis1), a11 = GetComponent(dpdv, axis1);
+
+    if (!SolveLinearSystem2x2(a00, a01, a10, a11, GetComponent(dpdx, axis0), GetComponent(dpdx, axis1), duvdx.u, duvdx.v))
+    {
+        duvdx = UV(0, 0);
+    }
+
+    if (!SolveLinearSystem2x2(a00, a01, a10, a11, GetComponent(dpdy, axis0), GetComponent(dpdy, axis1), duvdy.u, duvdy.v))
+    {
+        duvdy = UV(0, 0);
+    }
+}
+
+
+void RayPacket::Clear()
+{
+    size = 0;
+    coherent = false;
+}
+
+void RayPacket::AddRay(const Ray* ray, int ignoreShape)
+{
+    rays[size] = ray;
+    hits[size] = RayHit();
+    ignoreShapes[size] = ignoreShape;
+    ox[size] = ray->origin.x;
+    oy[size] = ray->origin.y;
+    oz[size] = ray->origin.z;
+    idx[size] = 1 / ray->direction.x;
+    idy[size] = 1 / ray->direction.y;
+    idz[size] = 1 / ray->direction.z;
+    size++;
+}
+
+void RayPacket::Finish()
+{
+    if (size == 0)
+    {
+        coherent = false;
+        return;
+    }
+
+    originMin = originMax = rays[0]->origin;
+    invDirMin = invDirMax = Vector3(idx[0], idy[0], idz[0]);
+    coherent = true;
+    for (int i = 0; i < size; i++)
+    {
+        Vector3 invDir = Vector3(idx[i], idy[i], idz[i]);
+        originMin = Vector3::Min(originMin, rays[i]->origin);
+        originMax = Vector3::Max(originMax, rays[i]->origin);
+        invDirMin = Vector3::Min(invDirMin, invDir);
+        invDirMax = Vector3::Max(invDirMax, invDir);
+
+        // the interval test needs the inverse directions to be finite and keep the same sign
+        if (!(fabs(invDir.x) < INFINITY && fabs(invDir.y) < INFINITY && fabs(invDir.z) < INFINITY))
+        {
+            coherent = false;
+        }
+    }
+
+    coherent = coherent && invDirMin.x * invDirMax.x > 0 && invDirMin.y * invDirMax.y > 0 && invDirMin.z * invDirMax.z > 0;
 }
\ No newline at end of file
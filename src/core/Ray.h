@@ -9,15 +9,43 @@
 
 using namespace std;
 
+// the indices of refraction of the materials a ray is inside of, innermost last. kept inline rather than
+// in a vector so rays can be copied without touching the heap
+struct IORStack
+{
+    static const int MAX_SIZE = 8;
+
+    Float values[MAX_SIZE];
+    int count = 0;
+
+    void push_back(Float ior);
+    void pop_back() { count--; }
+    Float back() const { return values[count - 1]; }
+    int size() const { return count; }
+};
+
 struct Ray 
 {
     Vector3 origin;
     Vector3 direction;
-    vector<Float> iors;
+    IORStack iors;
+
+    // ray differentials, i.e. the rays offset by one pixel in x and y (used for texture filtering)
+    bool hasDifferentials = false;
+    Vector3 rxOrigin, ryOrigin;
+    Vector3 rxDirection, ryDirection;
+
+    // roughness of the glossy reflections the ray came through, blurs the environment it sees
+    Float roughness = 0;
+
+    // upper bound on how much the ray's color adds to its pixel, the product of the fresnel weights above it
+    Float weight = 1;
 
     Ray();
 
     Ray(Vector3 origin, Vector3 direction, Float ior = 1);
+
+    void ScaleDifferentials(Float scale);
 };
 
 struct RayHit
@@ -33,6 +61,16 @@ struct RayHit
     int materialIndex = 0;
     int shapeIndex = 0;
 
+    // partial derivatives of the surface with respect to u and v (left at zero if the shape doesn't provide them)
+    Vector3 dpdu, dpdv;
+    Vector3 dndu, dndv;
+
+    // screen space derivatives, only filled in by ComputeDifferentials if the ray had differentials
+    Vector3 dpdx, dpdy;
+    UV duvdx, duvdy;
+
+    void ComputeDifferentials(Ray& ray);
+
     // logic operators for comparing RayHits
     operator bool() const { return hit; }
     bool operator<(const RayHit& rhs) const { return t < rhs.t; }
@@ -44,4 +82,30 @@ struct RayHit
 
 };
 
+// A few rays traced through the bvh together. The origins and inverse directions are kept one array per
+// component so the box tests for every ray run as one loop, and when the rays are coherent (their
+// directions all have the same signs) a box can be culled for the whole packet at once by testing it
+// against the bounds of their origins and directions.
+struct RayPacket
+{
+    static const int MAX_SIZE = 16;
+
+    int size = 0;
+    const Ray* rays[MAX_SIZE];
+    RayHit hits[MAX_SIZE];
+    int ignoreShapes[MAX_SIZE];     // a shape each ray should skip (for self shadowing), -1 for none
+
+    Float ox[MAX_SIZE], oy[MAX_SIZE], oz[MAX_SIZE];
+    Float idx[MAX_SIZE], idy[MAX_SIZE], idz[MAX_SIZE];
+
+    // bounds of the origins and inverse directions, only valid if coherent
+    bool coherent = false;
+    Vector3 originMin, originMax;
+    Vector3 invDirMin, invDirMax;
+
+    void Clear();
+    void AddRay(const Ray* ray, int ignoreShape = -1);
+    void Finish();      // works out the bounds once all the rays are in
+};
+
 #endif
\ No newline at end of file
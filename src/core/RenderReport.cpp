@@ -0,0 +1,98 @@
+#include "RenderReport.h"
+#include "ext/json.h"
+
+#include <fstream>
+#include <sys/resource.h>
+
+using json = nlohmann::json;
+
+static json GetRayCounts(const RenderCounters& counters, double seconds)
+{
+    uint64_t total = counters.GetRays() + counters.counts[COUNT_SHADOW_RAYS];
+    json rays;
+    rays["camera"] = counters.counts[COUNT_CAMERA_RAYS];
+    rays["reflection"] = counters.counts[COUNT_REFLECTION_RAYS];
+    rays["refraction"] = counters.counts[COUNT_REFRACTION_RAYS];
+    rays["shadow"] = counters.counts[COUNT_SHADOW_RAYS];
+    rays["total"] = total;
+    rays["per_second"] = seconds > 0 ? total / seconds : 0.0;
+    return rays;
+}
+
+int WriteRenderReport(string fileName, string sceneFile, string outputFile, Scene& scene, Camera& camera, double totalSeconds)
+{
+    json report;
+    report["scene"] = sceneFile;
+    report["output"] = outputFile;
+    report["image"] = { { "width", camera.GetPixelWidth() }, { "height", camera.GetPixelHeight() },
+                        { "samples", camera.GetNumSamples() }, { "bounces", camera.GetNumBounces() } };
+
+    // the textures are loaded while parsing, so take them out of the parse time
+    json times;
+    for (int i = 0; i < NUM_RENDER_PHASES; i++)
+    {
+        times[ScopedPhaseTimer::GetName((RenderPhase) i)] = ScopedPhaseTimer::GetTotal((RenderPhase) i);
+    }
+    times["parse"] = max(0.0, ScopedPhaseTimer::GetTotal(PHASE_PARSE) - ScopedPhaseTimer::GetTotal(PHASE_TEXTURES));
+    times["total"] = totalSeconds;
+    report["seconds"] = times;
+
+    RenderCounters totals = RenderCounters::GetTotals();
+    report["rays"] = GetRayCounts(totals, ScopedPhaseTimer::GetTotal(PHASE_RENDER));
+    report["traversal"] = { { "bvh_nodes", totals.counts[COUNT_NODES] }, { "sphere_tests", totals.counts[COUNT_SPHERE_TESTS] },
+                            { "triangle_tests", totals.counts[COUNT_TRIANGLE_TESTS] },
+                            { "cylinder_tests", totals.counts[COUNT_CYLINDER_TESTS] } };
+
+    json threads = json::array();
+    vector<ThreadRenderStats> threadStats = ThreadRenderStats::GetAll();
+    for (int i = 0; i < threadStats.size(); i++)
+    {
+        json thread = GetRayCounts(threadStats[i].counters, threadStats[i].seconds);
+        thread["seconds"] = threadStats[i].seconds;
+        threads.push_back(thread);
+    }
+    report["render_threads"] = threads;
+
+    // the scene's thread count gets capped by the number of rows, so report the threads that actually rendered
+    report["threads"] = threadStats.size();
+    report["threads_requested"] = camera.GetThreads();
+
+    // leaf_depths[d] is the number of leaves at depth d, and leaf_sizes[n] the number with n shapes
+    int nodes;
+    vector<int> leafDepths, leafSizes;
+    if (scene.GetBVHStats(nodes, leafDepths, leafSizes))
+    {
+        int leaves = 0;
+        for (int i = 0; i < leafDepths.size(); i++)
+        {
+            leaves += leafDepths[i];
+        }
+        report["bvh"] = { { "nodes", nodes }, { "leaves", leaves }, { "max_depth", (int) leafDepths.size() - 1 },
+                          { "leaf_depths", leafDepths }, { "leaf_sizes", leafSizes } };
+    }
+    else
+    {
+        report["bvh"] = nullptr;
+    }
+
+    // ru_maxrss is in bytes on macos and kilobytes on linux
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    report["peak_memory_mb"] = usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    report["peak_memory_mb"] = usage.ru_maxrss / 1024.0;
+#endif
+    report["texture_memory_mb"] = scene.GetTextureMemoryUsage() / (1024.0 * 1024.0);
+
+    ofstream file(fileName.c_str());
+    if (!file.is_open())
+    {
+        cout << "Error: Could not open file " << fileName << endl;
+        return 1;
+    }
+
+    file << report.dump(4) << endl;
+    file.close();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef RENDERREPORT_H
+#define RENDERREPORT_H
+
+#include "Camera.h"
+#include "Scene.h"
+#include "RenderStats.h"
+
+#include <string>
+
+using namespace std;
+
+// Writes a json summary of a run for dashboards and capacity planning: the time spent in each phase,
+// the rays traced by type and by each render thread, the shape of the bvh and the peak memory use.
+// Should be called once everything else is done, so every render thread has flushed its counters.
+int WriteRenderReport(string fileName, string sceneFile, string outputFile, Scene& scene, Camera& camera, double totalSeconds);
+
+#endif
\ No newline at end of file
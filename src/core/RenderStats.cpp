@@ -0,0 +1,278 @@
+#include "RenderStats.h"
+#include "Image.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+
+static const char* COUNTER_NAMES[NUM_RENDER_COUNTERS] = { "camera rays", "reflection rays", "refraction rays", "shadow rays",
+                                                          "bvh nodes", "sphere tests", "triangle tests", "cylinder tests" };
+static const char* METRIC_NAMES[CostHeatmap::NUM_METRICS] = { "rays", "shadowrays", "nodes", "tests", "cost" };
+
+static const char* PHASE_NAMES[NUM_RENDER_PHASES] = { "parse", "textures", "bvh", "render", "write" };
+
+static mutex totalsMutex;
+static RenderCounters totals = {};
+static vector<ThreadRenderStats> threadStats;
+
+static mutex phaseMutex;
+static double phaseTotals[NUM_RENDER_PHASES] = {};
+static thread_local int phaseDepths[NUM_RENDER_PHASES] = {};
+
+uint64_t RenderCounters::GetRays() const
+{
+    return counts[COUNT_CAMERA_RAYS] + counts[COUNT_REFLECTION_RAYS] + counts[COUNT_REFRACTION_RAYS];
+}
+
+uint64_t RenderCounters::GetPrimitiveTests() const
+{
+    return counts[COUNT_SPHERE_TESTS] + counts[COUNT_TRIANGLE_TESTS] + counts[COUNT_CYLINDER_TESTS];
+}
+
+void RenderCounters::Add(const RenderCounters& other)
+{
+    for (int i = 0; i < NUM_RENDER_COUNTERS; i++)
+    {
+        counts[i] += other.counts[i];
+    }
+}
+
+RenderCounters RenderCounters::Since(const RenderCounters& start) const
+{
+    RenderCounters diff;
+    for (int i = 0; i < NUM_RENDER_COUNTERS; i++)
+    {
+        diff.counts[i] = counts[i] - start.counts[i];
+    }
+    return diff;
+}
+
+const char* RenderCounters::GetName(RenderCounter counter)
+{
+    return COUNTER_NAMES[counter];
+}
+
+void RenderCounters::FlushLocal(double seconds)
+{
+    RenderCounters& local = Local();
+    lock_guard<mutex> lock(totalsMutex);
+    totals.Add(local);
+    threadStats.push_back({ local, seconds });
+    local = {};
+}
+
+RenderCounters RenderCounters::GetTotals()
+{
+    lock_guard<mutex> lock(totalsMutex);
+    return totals;
+}
+
+vector<ThreadRenderStats> ThreadRenderStats::GetAll()
+{
+    lock_guard<mutex> lock(totalsMutex);
+    return threadStats;
+}
+
+ScopedPhaseTimer::ScopedPhaseTimer(RenderPhase phase)
+{
+    this->phase = phase;
+    outermost = phaseDepths[phase]++ == 0;
+    stopped = false;
+    start = chrono::steady_clock::now();
+    if (Trace::IsEnabled())
+    {
+        traceStart = Trace::Now();
+    }
+}
+
+ScopedPhaseTimer::~ScopedPhaseTimer()
+{
+    Stop();
+}
+
+void ScopedPhaseTimer::Stop()
+{
+    if (stopped)
+    {
+        return;
+    }
+
+    stopped = true;
+    phaseDepths[phase]--;
+    if (Trace::IsEnabled())
+    {
+        Trace::AddEvent(PHASE_NAMES[phase], "phase", traceStart, Trace::Now());
+    }
+    if (outermost)
+    {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        lock_guard<mutex> lock(phaseMutex);
+        phaseTotals[phase] += seconds;
+    }
+}
+
+double ScopedPhaseTimer::GetTotal(RenderPhase phase)
+{
+    lock_guard<mutex> lock(phaseMutex);
+    return phaseTotals[phase];
+}
+
+const char* ScopedPhaseTimer::GetName(RenderPhase phase)
+{
+    return PHASE_NAMES[phase];
+}
+
+CostHeatmap::CostHeatmap()
+{
+    width = 0;
+    height = 0;
+    metric = METRIC_COST;
+}
+
+int CostHeatmap::ParseMetric(string name)
+{
+    for (int i = 0; i < NUM_METRICS; i++)
+    {
+        if (name == METRIC_NAMES[i])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void CostHeatmap::SetDimensions(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    pixels.assign(width * height, RenderCounters());
+}
+
+void CostHeatmap::SetPixel(int x, int y, const RenderCounters& counters)
+{
+    pixels[y * width + x] = counters;
+}
+
+uint64_t CostHeatmap::GetValue(const RenderCounters& counters, Metric metric)
+{
+    switch (metric)
+    {
+        case METRIC_RAYS:
+            return counters.GetRays();
+        case METRIC_SHADOW_RAYS:
+            return counters.counts[COUNT_SHADOW_RAYS];
+        case METRIC_NODES:
+            return counters.counts[COUNT_NODES];
+        case METRIC_TESTS:
+            return counters.GetPrimitiveTests();
+        default:
+            return counters.counts[COUNT_NODES] + counters.GetPrimitiveTests();
+    }
+}
+
+// t = 0 is black, t = 1 white, with red at t = 5/6
+Vector3 CostHeatmap::FalseColor(Float t)
+{
+    static Vector3 RAMP[7] = { Vector3(0, 0, 0), Vector3(0, 0, 1), Vector3(0, 1, 1), Vector3(0, 1, 0),
+                                     Vector3(1, 1, 0), Vector3(1, 0, 0), Vector3(1, 1, 1) };
+    t = max((Float) 0, min((Float) 1, t)) * 6;
+    int i = min((int) t, 5);
+    Float f = t - i;
+    return RAMP[i] * (1 - f) + RAMP[i + 1] * f;
+}
+
+int CostHeatmap::SaveToFilePPM(string fileName)
+{
+    vector<uint64_t> values(pixels.size());
+    for (int i = 0; i < pixels.size(); i++)
+    {
+        values[i] = GetValue(pixels[i], metric);
+    }
+
+    // scale by a high percentile rather than the max, so a few very expensive pixels don't wash out the rest
+    vector<uint64_t> sorted = values;
+    sort(sorted.begin(), sorted.end());
+    Float scale = sorted.empty() ? 1 : max((Float) sorted[(sorted.size() - 1) * 99 / 100], (Float) 1);
+
+    Image image(width, height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            image.SetPixel(x, y, FalseColor(values[y * width + x] / scale * 5 / 6));
+        }
+    }
+
+    cout << "Heatmap of " << METRIC_NAMES[metric] << " per pixel, red is " << (uint64_t) scale << endl;
+    return image.SaveToFilePPM(fileName);
+}
+
+// histogram with power of 2 buckets, the first holding 0
+static void PrintHistogram(const char* name, const vector<uint64_t>& values)
+{
+    vector<uint64_t> buckets;
+    for (int i = 0; i < values.size(); i++)
+    {
+        int bucket = 0;
+        for (uint64_t v = values[i]; v > 0; v >>= 1)
+        {
+            bucket++;
+        }
+        if (bucket >= buckets.size())
+        {
+            buckets.resize(bucket + 1, 0);
+        }
+        buckets[bucket]++;
+    }
+
+    uint64_t largest = *max_element(buckets.begin(), buckets.end());
+    cout << "  " << name << " per pixel:" << endl;
+    for (int i = 0; i < buckets.size(); i++)
+    {
+        uint64_t low = i == 0 ? 0 : (uint64_t) 1 << (i - 1);
+        uint64_t high = i == 0 ? 0 : ((uint64_t) 1 << i) - 1;
+        int bar = largest > 0 ? (int) (40 * buckets[i] / largest) : 0;
+        cout << "    " << setw(8) << low << " - " << setw(8) << high << " | " << left << setw(40) << string(bar, '#')
+             << right << " " << buckets[i] << endl;
+    }
+}
+
+void CostHeatmap::PrintSummary()
+{
+    RenderCounters sum = {};
+    for (int i = 0; i < pixels.size(); i++)
+    {
+        sum.Add(pixels[i]);
+    }
+
+    uint64_t cameraRays = max(sum.counts[COUNT_CAMERA_RAYS], (uint64_t) 1);
+    uint64_t tests = max(sum.GetPrimitiveTests(), (uint64_t) 1);
+    cout << "Render counters (per camera ray in brackets):" << endl;
+    for (int i = 0; i < NUM_RENDER_COUNTERS; i++)
+    {
+        cout << "  " << setw(16) << left << COUNTER_NAMES[i] << right << setw(14) << sum.counts[i]
+             << "  (" << (double) sum.counts[i] / cameraRays << ")";
+        if (i >= COUNT_SPHERE_TESTS)
+        {
+            cout << "  " << 100.0 * sum.counts[i] / tests << "% of tests";
+        }
+        cout << endl;
+    }
+
+    if (pixels.empty())
+    {
+        return;
+    }
+
+    vector<uint64_t> values(pixels.size());
+    for (int m = 0; m < NUM_METRICS; m++)
+    {
+        for (int i = 0; i < pixels.size(); i++)
+        {
+            values[i] = GetValue(pixels[i], (Metric) m);
+        }
+        PrintHistogram(METRIC_NAMES[m], values);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#ifndef RENDERSTATS_H
+#define RENDERSTATS_H
+
+#include "math/Vector3.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+
+using namespace std;
+
+// the kinds of work the render counters count
+enum RenderCounter
+{
+    COUNT_CAMERA_RAYS,
+    COUNT_REFLECTION_RAYS,
+    COUNT_REFRACTION_RAYS,
+    COUNT_SHADOW_RAYS,
+    COUNT_NODES,            // bvh nodes a ray was tested against
+    COUNT_SPHERE_TESTS,
+    COUNT_TRIANGLE_TESTS,
+    COUNT_CYLINDER_TESTS,
+    NUM_RENDER_COUNTERS
+};
+
+// Counts of the work done tracing rays. Every thread has its own set, so counting is just an increment
+// with no locking or shared cache lines, and a thread adds its counts into the global totals once it's
+// done rendering. The camera also reads them before and after each pixel to find what the pixel cost.
+struct RenderCounters
+{
+    uint64_t counts[NUM_RENDER_COUNTERS];
+
+    uint64_t GetRays() const;           // camera, reflection and refraction rays
+    uint64_t GetPrimitiveTests() const;
+    void Add(const RenderCounters& other);
+    RenderCounters Since(const RenderCounters& start) const;    // the counts added after start
+
+    static const char* GetName(RenderCounter counter);
+
+    static RenderCounters& Local();     // the calling thread's counters
+    static RenderCounters GetTotals();
+
+    // adds the calling thread's counters to the totals and zeroes them, seconds is how long the thread
+    // spent rendering and gets recorded with its counts
+    static void FlushLocal(double seconds);
+};
+
+// what one render thread did, recorded when it flushes its counters
+struct ThreadRenderStats
+{
+    RenderCounters counters;
+    double seconds;
+
+    static vector<ThreadRenderStats> GetAll();
+};
+
+inline RenderCounters& RenderCounters::Local()
+{
+    static thread_local RenderCounters counters = {};
+    return counters;
+}
+
+inline void CountRender(RenderCounter counter, uint64_t amount = 1)
+{
+    RenderCounters::Local().counts[counter] += amount;
+}
+
+// the parts a run's wall clock time is split into for the report
+enum RenderPhase
+{
+    PHASE_PARSE,            // reading the scene file, including the textures
+    PHASE_TEXTURES,         // decoding textures and building their mip levels
+    PHASE_BVH,
+    PHASE_RENDER,
+    PHASE_WRITE,
+    NUM_RENDER_PHASES
+};
+
+// Adds the time between its construction and destruction to a phase's total. Timers nested inside
+// another one for the same phase (like a texture load that builds the mip levels) only count once.
+// Every timer also shows up in the trace when tracing is enabled, nested ones included.
+class ScopedPhaseTimer
+{
+    public:
+        ScopedPhaseTimer(RenderPhase phase);
+        ~ScopedPhaseTimer();
+
+        void Stop();    // ends the phase early, the destructor then does nothing
+
+        static double GetTotal(RenderPhase phase);  // in seconds
+        static const char* GetName(RenderPhase phase);
+
+    private:
+        RenderPhase phase;
+        bool outermost;
+        bool stopped;
+        double traceStart;      // only set if tracing is enabled
+        chrono::steady_clock::time_point start;
+};
+
+// The counters of every pixel, for the heatmap mode. Writes the chosen metric as a false colour image
+// (black through blue, green, yellow and red to white, scaled so the 99th percentile pixel is red) and
+// prints totals and histograms of each metric over the pixels, to show where the time goes.
+class CostHeatmap
+{
+    public:
+        enum Metric
+        {
+            METRIC_RAYS,
+            METRIC_SHADOW_RAYS,
+            METRIC_NODES,
+            METRIC_TESTS,
+            METRIC_COST,        // nodes plus primitive tests, roughly the traversal work
+            NUM_METRICS
+        };
+
+        CostHeatmap();
+
+        static int ParseMetric(string name);    // -1 if there's no metric with that name
+
+        void SetMetric(Metric metric) { this->metric = metric; }
+        void SetDimensions(int width, int height);
+        void SetPixel(int x, int y, const RenderCounters& counters);
+
+        int SaveToFilePPM(string fileName);
+        void PrintSummary();
+
+    private:
+        int width;
+        int height;
+        Metric metric;
+        vector<RenderCounters> pixels;
+
+        static uint64_t GetValue(const RenderCounters& counters, Metric metric);
+        static Vector3 FalseColor(Float t);
+};
+
+#endif
\ No newline at end of file
@@ -152,6 +152,11 @@ void Scene::ClearLights()
 
 void Scene::AddTexture(shared_ptr<Image> texture)
 {
+    texture->GenerateMipmaps();
+    if (textureCache != nullptr)
+    {
+        texture->MoveToCache(textureCache);
+    }
     textures.push_back(texture);
     ApplyTexture(textures.size() - 1);
 }
@@ -170,6 +175,11 @@ void Scene::ApplyTexture(int index)
 
 void Scene::AddBumpMap(shared_ptr<Image> bumpMap)
 {
+    bumpMap->GenerateMipmaps();
+    if (textureCache != nullptr)
+    {
+        bumpMap->MoveToCache(textureCache);
+    }
     bumpMaps.push_back(bumpMap);
     ApplyBumpMap(bumpMaps.size() - 1);
 }
@@ -188,6 +198,11 @@ void Scene::ApplyBumpMap(int index)
 
 void Scene::AddSpecMap(shared_ptr<BWImage> specMap)
 {
+    specMap->GenerateMipmaps();
+    if (textureCache != nullptr)
+    {
+        specMap->MoveToCache(textureCache);
+    }
     specMaps.push_back(specMap);
     ApplySpecMap(specMaps.size() - 1);
 }
@@ -224,9 +239,10 @@ void Scene::SetDepthcueing(Vector3 color, Float near, Float far, Float startAlph
     depthcueing = true;
 }
 
-void Scene::SetSoftShadows(int numSamples)
+void Scene::SetSoftShadows(int numSamples, int numProbes)
 {
     shadowSamples = numSamples;
+    shadowProbes = numProbes;
 }
 
 void Scene::SetUseBVH(bool useBVH)
@@ -261,7 +277,16 @@ int Scene::GetBVHIdealShapesPerBV()
 
 void Scene::SetHDRI(shared_ptr<Image> hdri)
 {
+    ScopedPhaseTimer timer(PHASE_TEXTURES);
     this->hdri = hdri;
+    this->hdri->GenerateMipmaps();
+    environment = make_shared<EnvironmentMap>();
+    environment->Build(hdri);
+    if (textureCache != nullptr)
+    {
+        this->hdri->MoveToCache(textureCache);
+        environment->MoveToCache(textureCache);
+    }
     this->useHDRI = true;
 }
 
@@ -270,11 +295,83 @@ shared_ptr<Image> Scene::GetHDRI()
     return hdri;
 }
 
+void Scene::SetEnvironmentLight(Float strength, int numSamples)
+{
+    if (hdri == nullptr)
+    {
+        return;
+    }
+    environmentLight = make_shared<EnvironmentLight>(hdri, environment, strength, numSamples);
+}
+
+// textures loaded before the cache was set up get moved into it as well
+void Scene::SetTextureCache(size_t memoryBudget)
+{
+    ScopedPhaseTimer timer(PHASE_TEXTURES);
+    if (textureCache != nullptr)
+    {
+        return;
+    }
+
+    textureCache = make_shared<TextureCache>(memoryBudget);
+    for (int i = 0; i < textures.size(); i++)
+    {
+        textures[i]->MoveToCache(textureCache);
+    }
+    for (int i = 0; i < bumpMaps.size(); i++)
+    {
+        bumpMaps[i]->MoveToCache(textureCache);
+    }
+    for (int i = 0; i < specMaps.size(); i++)
+    {
+        specMaps[i]->MoveToCache(textureCache);
+    }
+    if (hdri != nullptr)
+    {
+        hdri->MoveToCache(textureCache);
+        environment->MoveToCache(textureCache);
+    }
+}
+
+size_t Scene::GetTextureMemoryUsage()
+{
+    size_t total = 0;
+    for (int i = 0; i < textures.size(); i++)
+    {
+        total += textures[i]->GetMemoryUsage();
+    }
+    for (int i = 0; i < bumpMaps.size(); i++)
+    {
+        total += bumpMaps[i]->GetMemoryUsage();
+    }
+    for (int i = 0; i < specMaps.size(); i++)
+    {
+        total += specMaps[i]->GetMemoryUsage();
+    }
+    if (hdri != nullptr)
+    {
+        total += hdri->GetMemoryUsage() + environment->GetMemoryUsage();
+    }
+    return total;
+}
+
 void Scene::AddMaterial(Material material)
 {
     materials.push_back(material);
 }
 
+void Scene::AddDefaultMaterial()
+{
+    Material defaultMaterial;
+    defaultMaterial.SetDiffuse(Vector3(0.8, 0.8, 0.8));
+    defaultMaterial.SetSpecular(Vector3(1.0, 1.0, 1.0));
+    defaultMaterial.SetK_A(0.4);
+    defaultMaterial.SetK_D(0.8);
+    defaultMaterial.SetK_S(0.4);
+    defaultMaterial.SetSpecFalloff(64.0);
+    AddMaterial(defaultMaterial);
+}
+
 void Scene::ClearMaterials()
 {
     materials.clear();
@@ -287,15 +384,23 @@ int Scene::GetNumMaterials()
 
 // since TraceRay() goes directly into ShadeRay(), I made Intersect a separate
 // function so I could find intersections without worrying about shading
-bool Scene::Intersect(Ray ray, RayHit& rayInfo, vector<int>& ignoreList)
+bool Scene::Intersect(Ray ray, RayHit& rayInfo, vector<int>& ignoreList, int hintShape)
 {
     RayHit bestHit;
     bestHit.t = INFINITY;
     bestHit.hit = false;
 
+    // a hit on the hint shape lets the BVH skip everything behind it
     RayHit hitInfo;
+    if (hintShape >= 0 && count(ignoreList.begin(), ignoreList.end(), hintShape) == 0 && shapes[hintShape]->Intersect(ray, hitInfo))
+    {
+        bestHit = hitInfo;
+        bestHit.shapeIndex = hintShape;
+    }
+
     if (useBVH)
     {   
+        hitInfo = bestHit;
         rootBV->Intersect(ray, hitInfo, ignoreList);
         if (hitInfo.hit)
         {
@@ -306,7 +411,7 @@ bool Scene::Intersect(Ray ray, RayHit& rayInfo, vector<int>& ignoreList)
     {
         for (int i = 0; i < shapes.size(); i++)
         {
-            if (count(ignoreList.begin(), ignoreList.end(), shapes[i]->id) != 0)
+            if (i == hintShape || count(ignoreList.begin(), ignoreList.end(), shapes[i]->id) != 0)
             {
                 continue;
             }
@@ -331,6 +436,29 @@ bool Scene::Intersect(Ray ray, RayHit& rayInfo, vector<int>& ignoreList)
     return false;
 }
 
+void Scene::IntersectPacket(RayPacket& packet)
+{
+    vector<int> ignoreList;
+    if (!useBVH || !packet.coherent)
+    {
+        for (int i = 0; i < packet.size; i++)
+        {
+            if (packet.ignoreShapes[i] >= 0)
+            {
+                ignoreList.assign(1, packet.ignoreShapes[i]);
+            }
+            else
+            {
+                ignoreList.clear();
+            }
+            Intersect(*packet.rays[i], packet.hits[i], ignoreList);
+        }
+        return;
+    }
+
+    rootBV->IntersectPacket(packet, ignoreList, (1u << packet.size) - 1);
+}
+
 Vector3 Scene::GetBackgroundColor()
 {
     return backgroundColor;
@@ -351,58 +479,278 @@ shared_ptr<Shape> Scene::GetShape(int index)
     return shapes[index];
 }
 
-// depth is currently ignored
-// intersect function makes traceray a little short for now
-Vector3 Scene::TraceRay(Ray ray, int depth, Float& dist)
+// one ray in the tree TraceRay is working through. it only holds plain data, so the stack of them can
+// be reused from ray to ray without any allocations
+struct TraceFrame
 {
+    enum Stage
+    {
+        FRAME_START,        // not traced yet
+        FRAME_REFLECT,      // waiting on the reflection ray
+        FRAME_REFRACT       // waiting on the refraction ray
+    };
+
+    Ray ray;
     RayHit hit;
+    ShadingPoint sp;
+    Ray refrRay;            // traced once the reflection is done
+    Vector3 reflColor, refrColor;
+    Float dist, refrDist;
+    Float fr, reflScale, refrScale;
+    int depth;
+    Stage stage;
+    bool refraction;
+};
+
+// per thread so the frames and light picks get allocated once rather than for every ray
+struct TraceStack
+{
+    vector<TraceFrame> frames;
+    vector<pair<int, Float>> picks;
+};
+
+static thread_local TraceStack traceStack;
+
+// follows the reflection and refraction rays depth first with an explicit stack rather than recursion,
+// visiting the rays in the same order recursion would so the random numbers get used in the same order
+Vector3 Scene::TraceRay(Ray ray, int depth, Float& dist, SurfaceFeatures* features)
+{
+    vector<TraceFrame>& frames = traceStack.frames;
+    if (frames.size() < max(depth, 0) + 2)
+    {
+        frames.resize(max(depth, 0) + 2);
+    }
+
     vector<int> ignoreList;
+    int top = 0;
+    frames[0].ray = ray;
+    frames[0].depth = depth;
+    frames[0].stage = TraceFrame::FRAME_START;
 
-    Intersect(ray, hit, ignoreList);
+    while (true)
+    {
+        TraceFrame& frame = frames[top];
+        TraceFrame& child = frames[top + 1];
+        Vector3 color;
 
-    dist = hit ? hit.t : -1;
+        switch (frame.stage)
+        {
+            case TraceFrame::FRAME_START:
+                if (top == 0)
+                {
+                    CountRender(COUNT_CAMERA_RAYS);
+                }
+                else
+                {
+                    CountRender(frames[top - 1].stage == TraceFrame::FRAME_REFLECT ? COUNT_REFLECTION_RAYS : COUNT_REFRACTION_RAYS);
+                }
+                frame.hit = RayHit();
+                Intersect(frame.ray, frame.hit, ignoreList);
+                frame.dist = frame.hit ? frame.hit.t : -1;
+                if (ShadeRay(frame.ray, frame.hit, frame.depth, frame.sp, color, traceStack.picks))
+                {
+                    break;
+                }
 
-    return ShadeRay(ray, hit, depth);
+                frame.fr = GetFresnelRays(frame.ray, frame.hit, frame.sp, child.ray, frame.refrRay, frame.refraction);
+                frame.stage = TraceFrame::FRAME_REFLECT;
+                if (SurviveRoulette(child.ray, frame.reflScale))
+                {
+                    child.depth = frame.depth - 1;
+                    child.stage = TraceFrame::FRAME_START;
+                    top++;
+                    continue;
+                }
+                frame.reflColor = Vector3::zero;
+                // fall through, there's no reflection to wait for
+
+            case TraceFrame::FRAME_REFLECT:
+                if (!frame.refraction)
+                {
+                    color = FinishShading(frame.sp, frame.reflColor, frame.hit);
+                    break;
+                }
+
+                frame.stage = TraceFrame::FRAME_REFRACT;
+                frame.refrColor = Vector3::zero;
+                frame.refrDist = -1;
+                if (SurviveRoulette(frame.refrRay, frame.refrScale))
+                {
+                    child.ray = frame.refrRay;
+                    child.depth = frame.depth - 1;
+                    child.stage = TraceFrame::FRAME_START;
+                    top++;
+                    continue;
+                }
+                // fall through
+
+            case TraceFrame::FRAME_REFRACT:
+                color = FinishShading(frame.sp, CombineFresnel(frame.hit, frame.fr, frame.reflColor, frame.refrColor, frame.refrDist,
+                                                               frame.sp.diffuse, frame.refrScale), frame.hit);
+                break;
+        }
+
+        // the frame's done, hand its color back to its parent
+        if (top == 0)
+        {
+            dist = frame.dist;
+            if (features != nullptr)
+            {
+                GetSurfaceFeatures(frame.hit, frame.sp, *features);
+            }
+            return color;
+        }
+
+        TraceFrame& parent = frames[--top];
+        if (parent.stage == TraceFrame::FRAME_REFLECT)
+        {
+            parent.reflColor = color * parent.reflScale;
+        }
+        else
+        {
+            parent.refrColor = color;
+            parent.refrDist = frame.dist;
+        }
+    }
 }
 
-// for now shadeRay will just return the color of the material plus
-// basic shading with ambient light and single directional light
-Vector3 Scene::ShadeRay(Ray ray, RayHit hitInfo, int depth)
+// the direct lighting for a hit, returns true if that's its final color. otherwise sp is set up and the
+// color still needs the reflection and refraction added by FinishShading
+bool Scene::ShadeRay(Ray& ray, RayHit& hitInfo, int depth, ShadingPoint& sp, Vector3& color, vector<pair<int, Float>>& picks)
 {
     if (!hitInfo)
     {
-        return SampleHDRI(ray.direction);
+        color = SampleHDRI(ray);
+        return true;
     }
 
+    // find the texture footprint of the hit for mipmapping
+    hitInfo.ComputeDifferentials(ray);
+
     // if no lights provided, render scene unlit
     if (unlit)
     {
-        return materials[hitInfo.materialIndex].GetUnlit(hitInfo, textures, bumpMaps);
+        color = GetUnlitColor(hitInfo);
+        return true;
     }
 
     // now calculate lighting for each light
-    Vector3 normal = materials[hitInfo.materialIndex].CalculateNormal(hitInfo, bumpMaps);
-    Vector3 viewDir = (ray.origin - hitInfo.position).normalized();
-    Vector3 reflect = 2.0 * Vector3::Project(viewDir, normal) - viewDir;
-    reflect.Normalize();
-    Vector3 diffuse = Vector3::zero, specular = Vector3::zero;
-    for (int i = 0; i < lights.size(); i++)
+    SetupShadingPoint(ray, hitInfo, sp);
+    PickLights(hitInfo, picks);
+    for (int i = 0; i < picks.size(); i++)
     {
-        GetColorFromLight(i, reflect, viewDir, normal, ray, hitInfo, diffuse, specular);
+        GetColorFromLight(picks[i].first, sp, ray, hitInfo, picks[i].second);
     }
-
-    // add ambient light
-    Vector3 ambient = materials[hitInfo.materialIndex].GetAmbient(hitInfo, textures, bumpMaps);
+    AddEnvironmentLight(sp, ray, hitInfo);
 
     if (depth <= 0)
     {
         // if depth is negative, don't do reflection/refraction
-        return ambient + diffuse + specular;
+        color = sp.ambient + sp.diffuse + sp.specular;
+        return true;
+    }
+
+    return false;
+}
+
+// works out the shading normal and directions for a hit, and its ambient light
+void Scene::SetupShadingPoint(Ray& ray, RayHit& hitInfo, ShadingPoint& sp)
+{
+    sp.normal = materials[hitInfo.materialIndex].CalculateNormal(hitInfo, bumpMaps);
+    sp.viewDir = (ray.origin - hitInfo.position).normalized();
+    sp.reflect = 2.0 * Vector3::Project(sp.viewDir, sp.normal) - sp.viewDir;
+    sp.reflect.Normalize();
+    sp.diffuse = Vector3::zero;
+    sp.specular = Vector3::zero;
+    sp.material = materials[hitInfo.materialIndex].Sample(hitInfo, textures, specMaps);
+    sp.ambient = materials[hitInfo.materialIndex].GetAmbient(sp.material);
+}
+
+// the lights to shade the hit with and how much to weight each of them
+void Scene::PickLights(RayHit& hitInfo, vector<pair<int, Float>>& picks)
+{
+    picks.clear();
+    if (lightBVH != nullptr)
+    {
+        // lights that can't go in the bvh always get shaded, then pick a few of the rest weighted
+        // by how much they could light this point, dividing by the chance of picking them
+        const vector<int>& unbounded = lightBVH->GetUnboundedLights();
+        for (int i = 0; i < unbounded.size(); i++)
+        {
+            picks.push_back(make_pair(unbounded[i], (Float) 1));
+        }
+        for (int i = 0; i < lightSamples; i++)
+        {
+            // stratify the random numbers so the samples spread out over the lights
+            Float pmf;
+            Float u = (i + RandomFloat()) / lightSamples;
+            int lightInd = lightBVH->Sample(hitInfo.position, u, pmf);
+            if (lightInd >= 0)
+            {
+                picks.push_back(make_pair(lightInd, 1 / (pmf * lightSamples)));
+            }
+        }
+    }
+    else
+    {
+        // only shade the lights whose influence radius reaches this point, using the same offset point
+        // the shading does so the cull agrees with the early out in GetLightContribution
+        Vector3 lightPoint = hitInfo.position + hitInfo.normal * 0.01;
+        const vector<int>& candidates = lightGrid->GetLights(lightPoint);
+        for (int i = 0; i < candidates.size(); i++)
+        {
+            if (lights[candidates[i]]->Influences(lightPoint))
+            {
+                picks.push_back(make_pair(candidates[i], (Float) 1));
+            }
+        }
+    }
+}
+
+Vector3 Scene::GetUnlitColor(RayHit& hitInfo)
+{
+    return materials[hitInfo.materialIndex].GetUnlit(hitInfo, textures);
+}
+
+// sp only needs to be set up if the hit was shaded, i.e. it's a hit and the scene isn't unlit
+void Scene::GetSurfaceFeatures(RayHit& hitInfo, ShadingPoint& sp, SurfaceFeatures& features)
+{
+    if (!hitInfo)
+    {
+        features.albedo = Vector3::one;
+        features.normal = Vector3::zero;
+        features.depth = -1;
+        features.shapeID = -1;
+        features.materialID = -1;
+        return;
+    }
+
+    features.depth = hitInfo.t;
+    features.shapeID = hitInfo.shapeIndex;
+    features.materialID = hitInfo.materialIndex;
+    if (unlit)
+    {
+        features.albedo = GetUnlitColor(hitInfo);
+        features.normal = hitInfo.normal;
+        return;
     }
 
-    // add reflection/refraction
-    Vector3 fresnel = GetFresnelColor(ray, hitInfo, reflect, viewDir, normal, diffuse, depth);
-    Vector3 col = ambient + specular + fresnel; // diffuse gets included in fresnel
+    features.albedo = sp.material.diffuse;
+    features.normal = sp.normal;
+}
+
+void Scene::AddEnvironmentLight(ShadingPoint& sp, Ray& ray, RayHit& hitInfo)
+{
+    if (environmentLight != nullptr)
+    {
+        GetColorFromEnvironment(sp, ray, hitInfo);
+    }
+}
+
+// adds the reflection/refraction color, depth cueing and clamps the result
+Vector3 Scene::FinishShading(ShadingPoint& sp, Vector3 fresnel, RayHit& hitInfo)
+{
+    Vector3 col = sp.ambient + sp.specular + fresnel; // diffuse gets included in fresnel
 
     if (depthcueing)
     {
@@ -423,86 +771,209 @@ Vector3 Scene::ShadeRay(Ray ray, RayHit hitInfo, int depth)
 }
 
 // helper function for ShadeRay()
-Vector3 Scene::GetColorFromLight(int lightInd, Vector3 reflect, Vector3 viewDir, Vector3 normal, Ray ray, RayHit hitInfo, Vector3& diffuse, Vector3& specular)
+// weight scales the light's contribution, for when it was picked at random from many lights
+void Scene::GetColorFromLight(int lightInd, ShadingPoint& sp, Ray& ray, RayHit& hitInfo, Float weight)
 {
-    vector<int> ignoreList;
-    if (shapes[hitInfo.shapeIndex]->IgnoreSelfShadowing())
+    Vector3 lightDiffuse, lightSpecular;
+    if (GetLightContribution(lightInd, sp, ray, hitInfo, weight, lightDiffuse, lightSpecular))
     {
-        ignoreList.push_back(hitInfo.shapeIndex);
+        AddShadowedLight(sp, GetShadow(lightInd, hitInfo), lightDiffuse, lightSpecular);
     }
+}
 
+// the light's diffuse and specular contribution ignoring shadows, returns false if it's too dim to shade
+bool Scene::GetLightContribution(int lightInd, ShadingPoint& sp, Ray& ray, RayHit& hitInfo, Float weight, Vector3& lightDiffuse, Vector3& lightSpecular)
+{
     // first get relatvent info about light and the collision
     shared_ptr<Light> light = lights[lightInd];
     Vector3 point = hitInfo.position + hitInfo.normal * 0.01;
 
     Vector3 lightDir = -light->GetDirectionAt(point);
-    Float dist = light->GetDistanceFrom(point);
     Vector3 lightCol = light->color * light->GetIntensityAt(point);
 
     // if color is black, don't bother shading
-    if (lightCol.sqrMagnitude() < 0.0001)
+    if (lightCol.sqrMagnitude() < LIGHT_CUTOFF * LIGHT_CUTOFF)
     {
-        return Vector3(0, 0, 0);
+        return false;
     }
+    lightCol *= weight;
 
-    Ray shadowRay;
-    RayHit shadowHit;
+    // now use phong illumination to calculate color
+    // i'm using r*l instead of n*h for specular because i think it looks better
+    // plus we'll need r for reflections/refractions later
+    Float diffuseAmt = sp.normal.dot(lightDir);
+    Float specAmt = lightDir.dot(sp.reflect);
+
+    materials[hitInfo.materialIndex].GetColorNoAmbient(sp.material, diffuseAmt, specAmt, lightCol, lightDiffuse, lightSpecular);
+    return true;
+}
 
-    // now determine shadow value
-    Vector3 shadowCol = Vector3::zero;
-    if (shadowSamples < 2) // if samples is set to 1 or less, just do hard shadows
+// how much of the light gets to the hit
+Vector3 Scene::GetShadow(int lightInd, RayHit& hitInfo)
+{
+    vector<int> ignoreList;
+    if (shapes[hitInfo.shapeIndex]->IgnoreSelfShadowing())
     {
-        shadowRay = Ray(point, lightDir);
-        shadowCol += ShadowTrace(shadowRay, dist, ignoreList);
+        ignoreList.push_back(hitInfo.shapeIndex);
     }
-    else
+
+    shared_ptr<Light> light = lights[lightInd];
+    Vector3 point = hitInfo.position + hitInfo.normal * 0.01;
+
+    // if samples is set to 1 or less, just do hard shadows
+    if (shadowSamples < 2)
     {
-        // otherwise, do soft shadows by offsetting the light source randomly and shooting out a bunch of rays
-        // it might be less noisy if I did a uniform distribution of offsets in a grid around the light source
-        // but I'll try that later
-        for (int i = 0; i < shadowSamples; i++)
+        Vector3 lightDir = -light->GetDirectionAt(point);
+        Float dist = light->GetDistanceFrom(point);
+        return ShadowTrace(Ray(point, lightDir), dist, ignoreList, lightInd);
+    }
+    return SoftShadowTrace(lightInd, point, ignoreList);
+}
+
+// hard shadows for a few hits at once, tracing the first leg of their shadow rays as a packet
+void Scene::GetShadowPacket(int lightInd, RayHit** hitInfos, int count, Vector3* shadows)
+{
+    shared_ptr<Light> light = lights[lightInd];
+    if (shadowSamples >= 2)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            shadows[i] = GetShadow(lightInd, *hitInfos[i]);
+        }
+        return;
+    }
+
+    Ray shadowRays[RayPacket::MAX_SIZE];
+    Float dists[RayPacket::MAX_SIZE];
+    RayPacket packet;
+    for (int i = 0; i < count; i++)
+    {
+        RayHit& hitInfo = *hitInfos[i];
+        Vector3 point = hitInfo.position + hitInfo.normal * 0.01;
+        Vector3 lightDir = -light->GetDirectionAt(point);
+        dists[i] = light->GetDistanceFrom(point);
+        shadowRays[i] = Ray(point, lightDir);
+        packet.AddRay(&shadowRays[i], shapes[hitInfo.shapeIndex]->IgnoreSelfShadowing() ? hitInfo.shapeIndex : -1);
+    }
+    packet.Finish();
+    IntersectPacket(packet);
+
+    vector<int> ignoreList;
+    for (int i = 0; i < count; i++)
+    {
+        ignoreList.clear();
+        if (packet.ignoreShapes[i] >= 0)
         {
-            Vector3 lightOffset = Vector3((rand() / (Float) RAND_MAX) - 0.5, (rand() / (Float) RAND_MAX) - 0.5, (rand() / (Float) RAND_MAX) - 0.5);
-            Vector3 lightPoint = lightDir * dist + 2.0 * lightOffset;
-            shadowRay = Ray(point, lightPoint.normalized());
-            shadowCol += ShadowTrace(shadowRay, dist, ignoreList);
+            ignoreList.push_back(packet.ignoreShapes[i]);
         }
+        shadows[i] = ShadowTrace(shadowRays[i], dists[i], ignoreList, lightInd, &packet.hits[i]);
     }
+}
 
+void Scene::AddShadowedLight(ShadingPoint& sp, Vector3 shadowCol, Vector3 lightDiffuse, Vector3 lightSpecular)
+{
     if (shadowCol.magnitude() < 0.0001)
     {
-        return Vector3(0, 0, 0);
+        return;
     }
 
-    shadowCol /= (Float) shadowSamples;
+    lightDiffuse *= shadowCol;
+    lightSpecular *= shadowCol;
+    sp.diffuse += lightDiffuse;
+    sp.specular += lightSpecular;
+}
 
-    // now use phong illumination to calculate color
-    // i'm using r*l instead of n*h for specular because i think it looks better
-    // plus we'll need r for reflections/refractions later
-    Float diffuseAmt = normal.dot(lightDir);
-    Float specAmt = lightDir.dot(reflect);
+// latin hypercube samples, so each of the count rows and columns of the unit square gets exactly one
+static void GetStratifiedSamples(int count, vector<UV>& samples)
+{
+    samples.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        samples[i].u = (i + RandomFloat()) / count;
+        samples[i].v = (i + RandomFloat()) / count;
+    }
 
-    Vector3 tempDiff, tempSpec;
-    materials[hitInfo.materialIndex].GetColorNoAmbient(hitInfo, textures, bumpMaps, specMaps, diffuseAmt, specAmt, lightCol, tempDiff, tempSpec);
-    tempDiff *= shadowCol;
-    tempSpec *= shadowCol;
-    diffuse += tempDiff;
-    specular += tempSpec;
+    // shuffle the rows so they pair up with the columns at random
+    for (int i = count - 1; i > 0; i--)
+    {
+        swap(samples[i].v, samples[RandomInt(i + 1)].v);
+    }
+}
+
+// averages shadow rays aimed at spots spread over the light. a few probe rays go first, and the rest are
+// only traced if the probes disagree, since a point that's fully lit or fully shadowed gets the same
+// answer from every ray
+Vector3 Scene::SoftShadowTrace(int lightInd, Vector3 point, vector<int>& ignoreList)
+{
+    shared_ptr<Light> light = lights[lightInd];
+    vector<UV> samples;
+    Vector3 total = Vector3::zero;
+    Float dist;
+
+    int numProbes = shadowProbes < shadowSamples ? shadowProbes : 0;
+    if (numProbes > 0)
+    {
+        GetStratifiedSamples(numProbes, samples);
+        Vector3 first;
+        bool penumbra = false;
+        for (int i = 0; i < numProbes; i++)
+        {
+            Vector3 dir = light->SampleShadowRay(point, samples[i].u, samples[i].v, dist);
+            Vector3 col = ShadowTrace(Ray(point, dir), dist, ignoreList, lightInd);
+            if (i == 0)
+            {
+                first = col;
+            }
+            else if ((col - first).sqrMagnitude() > 1e-6)
+            {
+                penumbra = true;
+            }
+            total += col;
+        }
+
+        if (!penumbra)
+        {
+            return total / (Float) numProbes;
+        }
+    }
+
+    GetStratifiedSamples(shadowSamples, samples);
+    for (int i = 0; i < shadowSamples; i++)
+    {
+        Vector3 dir = light->SampleShadowRay(point, samples[i].u, samples[i].v, dist);
+        total += ShadowTrace(Ray(point, dir), dist, ignoreList, lightInd);
+    }
 
-    return tempDiff + tempSpec;
+    // the probes were stratified too, so they can be averaged in with the rest
+    return total / (Float) (numProbes + shadowSamples);
 }
 
-Vector3 Scene::GetFresnelColor(Ray ray, RayHit hitInfo, Vector3 reflect, Vector3 viewDir, Vector3 normal, Vector3 diffuse, int depth)
+// sets up the reflection and refraction rays and returns the fresnel coefficient, refraction is left false
+// for total internal reflection
+Float Scene::GetFresnelRays(Ray ray, RayHit hitInfo, ShadingPoint& sp, Ray& reflRay, Ray& refrRay, bool& refraction)
 {
+    Vector3 normal = sp.normal;
+    Vector3 viewDir = sp.viewDir;
+
+    // change in the normal across a pixel, needed to propagate the ray differentials
+    Vector3 dndx = hitInfo.dndu * hitInfo.duvdx.u + hitInfo.dndv * hitInfo.duvdx.v;
+    Vector3 dndy = hitInfo.dndu * hitInfo.duvdy.u + hitInfo.dndv * hitInfo.duvdy.v;
+
     if (viewDir.dot(normal) < 0)
     {
         normal = -normal;
+        dndx = -dndx;
+        dndy = -dndy;
     }
 
-    // first find reflection color
-    Ray reflRay = Ray(hitInfo.position + normal * 0.01, reflect);
-    Float reflDist;
-    Vector3 reflColor = TraceRay(reflRay, depth - 1, reflDist);
+    // first set up the reflection ray
+    reflRay = Ray(hitInfo.position + normal * 0.01, sp.reflect);
+    reflRay.roughness = max(ray.roughness, materials[hitInfo.materialIndex].GetRoughness());
+    reflRay.weight = ray.weight;
+    if (ray.hasDifferentials)
+    {
+        SetReflectedDifferentials(ray, hitInfo, normal, dndx, dndy, reflRay);
+    }
 
     // next calculate the fresnel coefficient
     Float eta_i, eta_t; // first get the indices of refraction
@@ -524,26 +995,37 @@ Vector3 Scene::GetFresnelColor(Ray ray, RayHit hitInfo, Vector3 reflect, Vector3
         eta_t = materials[hitInfo.materialIndex].GetIOR();
         ray.iors.push_back(eta_t);
     }
-    Float f0 = pow((eta_i - eta_t) / (eta_i + eta_t), 2);
+    Float f0 = Square((eta_i - eta_t) / (eta_i + eta_t));
     Float cos_i = viewDir.dot(normal);
     Float cos_t2 = 1 - (eta_i * eta_i) / (eta_t * eta_t) * (1 - cos_i * cos_i);
-    Float fr = f0 + (1 - f0) * pow(1 - cos_i, 5);
+    Float fr = f0 + (1 - f0) * SchlickWeight(cos_i);
     fr *= materials[hitInfo.materialIndex].GetK_S();
 
-    if (cos_t2 < 0)
+    refraction = cos_t2 >= 0;
+    if (!refraction)
     {
         // total internal reflection, only do reflection
-        return reflColor;
+        return fr;
     }
+    reflRay.weight = ray.weight * fr;
 
-    // otherwise we now need to calculate the refraction color
+    // otherwise we now need the refraction ray
     Float cos_t = sqrt(cos_t2);
     Vector3 refr = -normal * cos_t + eta_i / eta_t * (cos_i * normal - viewDir);
-    Ray refrRay = Ray(hitInfo.position - normal * 0.01, refr);
-    refrRay.iors = vector<Float>(ray.iors);
-    Float refrDist;
-    Vector3 refrColor = TraceRay(refrRay, depth - 1, refrDist);
+    refrRay = Ray(hitInfo.position - normal * 0.01, refr);
+    refrRay.iors = ray.iors;
+    refrRay.roughness = ray.roughness;
+    refrRay.weight = ray.weight * (1 - fr);
+    if (ray.hasDifferentials)
+    {
+        SetRefractedDifferentials(ray, hitInfo, normal, dndx, dndy, eta_i / eta_t, refrRay);
+    }
+    return fr;
+}
 
+// mixes the reflected and refracted colors once they've been traced
+Vector3 Scene::CombineFresnel(RayHit& hitInfo, Float fr, Vector3 reflColor, Vector3 refrColor, Float refrDist, Vector3 diffuse, Float refrScale)
+{
     if (!hitInfo.inside)
     {
         // account for opacity of material
@@ -561,19 +1043,249 @@ Vector3 Scene::GetFresnelColor(Ray ray, RayHit hitInfo, Vector3 reflect, Vector3
         refrColor = opacity * refrColor + (1 - opacity) * diffuse;
     }
 
-    return fr * reflColor + (1 - fr) * refrColor;
+    return fr * reflColor + (1 - fr) * refrScale * refrColor;
+}
+
+// russian roulette for the reflection and refraction rays. rays that can add less than the threshold
+// to their pixel get traced with probability weight / threshold and have their color scaled up by the
+// inverse to make up for the ones that weren't, so the image stays the same on average. rays below the
+// cutoff are always dropped. scale is 0 for dropped rays, and what to multiply the color by otherwise
+bool Scene::SurviveRoulette(Ray& ray, Float& scale)
+{
+    scale = 1;
+    if (ray.weight >= rouletteThreshold)
+    {
+        return true;
+    }
+
+    Float p = ray.weight / rouletteThreshold;
+    if (ray.weight < rouletteCutoff || RandomFloat() >= p)
+    {
+        scale = 0;
+        return false;
+    }
+
+    // its color gets scaled up, so the rays below it can add that much more
+    scale = 1 / p;
+    ray.weight = rouletteThreshold;
+    return true;
+}
+
+void Scene::SetRoulette(Float threshold, Float cutoff)
+{
+    rouletteThreshold = threshold;
+    rouletteCutoff = cutoff;
+}
+
+// reflects the ray differentials about the normal, following pbrt:
+// https://pbr-book.org/3ed-2018/Texture/Sampling_and_Antialiasing#ReflectionandTransmission
+void Scene::SetReflectedDifferentials(Ray& ray, RayHit& hitInfo, Vector3 normal, Vector3 dndx, Vector3 dndy, Ray& reflRay)
+{
+    Vector3 wo = -ray.direction;
+    Vector3 dwodx = -ray.rxDirection - wo;
+    Vector3 dwody = -ray.ryDirection - wo;
+    Float dDNdx = dwodx.dot(normal) + wo.dot(dndx);
+    Float dDNdy = dwody.dot(normal) + wo.dot(dndy);
+    Float woDotN = wo.dot(normal);
+
+    reflRay.hasDifferentials = true;
+    reflRay.rxOrigin = reflRay.origin + hitInfo.dpdx;
+    reflRay.ryOrigin = reflRay.origin + hitInfo.dpdy;
+    reflRay.rxDirection = reflRay.direction - dwodx + 2.0 * (woDotN * dndx + dDNdx * normal);
+    reflRay.ryDirection = reflRay.direction - dwody + 2.0 * (woDotN * dndy + dDNdy * normal);
+}
+
+// same as above but bends the differentials through the surface, eta is eta_i / eta_t
+// assumes the normal is facing the incoming ray
+void Scene::SetRefractedDifferentials(Ray& ray, RayHit& hitInfo, Vector3 normal, Vector3 dndx, Vector3 dndy, Float eta, Ray& refrRay)
+{
+    Vector3 wo = -ray.direction;
+    Vector3 wi = refrRay.direction;
+    Vector3 dwodx = -ray.rxDirection - wo;
+    Vector3 dwody = -ray.ryDirection - wo;
+    Float dDNdx = dwodx.dot(normal) + wo.dot(dndx);
+    Float dDNdy = dwody.dot(normal) + wo.dot(dndy);
+
+    Float wiDotN = wi.dot(normal);
+    if (wiDotN == 0)
+    {
+        return;
+    }
+
+    Float woDotN = wo.dot(normal);
+    Float mu = eta * woDotN + wiDotN;
+    Float dmu = eta + (eta * eta * woDotN) / wiDotN;
+
+    refrRay.hasDifferentials = true;
+    refrRay.rxOrigin = refrRay.origin + hitInfo.dpdx;
+    refrRay.ryOrigin = refrRay.origin + hitInfo.dpdy;
+    refrRay.rxDirection = wi - eta * dwodx + (mu * dndx + dmu * dDNdx * normal);
+    refrRay.ryDirection = wi - eta * dwody + (mu * dndy + dmu * dDNdy * normal);
+}
+
+// estimates the diffuse light from the hdri by shooting shadow rays in directions importance sampled
+// from it, the specular part isn't included since the reflection rays already pick up the environment
+Vector3 Scene::GetColorFromEnvironment(ShadingPoint& sp, Ray ray, RayHit hitInfo)
+{
+    vector<int> ignoreList;
+    if (shapes[hitInfo.shapeIndex]->IgnoreSelfShadowing())
+    {
+        ignoreList.push_back(hitInfo.shapeIndex);
+    }
+
+    Vector3 point = hitInfo.position + hitInfo.normal * 0.01;
+    Vector3 lightCol = Vector3::zero;
+    int numSamples = environmentLight->numSamples;
+    for (int i = 0; i < numSamples; i++)
+    {
+        Vector3 lightDir;
+        Float pdf;
+        Vector3 radiance = environmentLight->Sample(RandomFloat(), RandomFloat(), lightDir, pdf);
+        Float cosTheta = sp.normal.dot(lightDir);
+        if (pdf <= 0 || cosTheta <= 0 || radiance.sqrMagnitude() < 0.0001)
+        {
+            continue;
+        }
+
+        Ray shadowRay = Ray(point, lightDir);
+        Vector3 shadowCol = ShadowTrace(shadowRay, INFINITY, ignoreList);
+
+        // divide by pi so a uniformly white environment lights like a white directional light head on,
+        // the cosine term gets applied by the material
+        lightCol += radiance * shadowCol * (cosTheta / (M_PI * pdf));
+    }
+
+    if (lightCol.sqrMagnitude() < 0.0001)
+    {
+        return Vector3(0, 0, 0);
+    }
+    lightCol /= (Float) numSamples;
+
+    // pass a diffuse amount of 1 since the cosine was already included per sample
+    Vector3 tempDiff, tempSpec;
+    materials[hitInfo.materialIndex].GetColorNoAmbient(sp.material, 1, 0, lightCol, tempDiff, tempSpec);
+    sp.diffuse += tempDiff;
+
+    return tempDiff;
 }
 
+// the shape that last blocked each light's shadow rays on this thread. neighbouring pixels usually have
+// the same occluder, so testing it first gives the BVH a close hit to cull the rest of the traversal with.
+// where it keeps turning out wrong each test is wasted, so a light stops using it after MAX_MISSES wrong
+// guesses in a row, until the next reset
+struct ShadowOccluderCache
+{
+    static const int MAX_MISSES = 8;
+
+    const Scene* owner = nullptr;
+    vector<int> occluders;  // per light, -1 if nothing was in the way
+    vector<int> misses;     // per light, wrong guesses in a row
+    shared_ptr<ShadowCacheStats> stats;
+    uint64_t lookups = 0;
+    uint64_t tested = 0;
+    uint64_t hits = 0;
+
+    ~ShadowOccluderCache()
+    {
+        Flush();
+    }
+
+    void Flush()
+    {
+        if (stats != nullptr)
+        {
+            stats->lookups += lookups;
+            stats->tested += tested;
+            stats->hits += hits;
+        }
+        lookups = 0;
+        tested = 0;
+        hits = 0;
+    }
+};
+
+static thread_local ShadowOccluderCache occluderCache;
+
+void Scene::ResetShadowCache()
+{
+    ShadowOccluderCache& cache = occluderCache;
+    cache.Flush();
+    cache.owner = this;
+    cache.stats = shadowCacheStats;
+    cache.occluders.assign(lights.size(), -1);
+    cache.misses.assign(lights.size(), 0);
+}
+
+void Scene::PrintShadowCacheStats()
+{
+    occluderCache.Flush();
+
+    uint64_t lookups = shadowCacheStats->lookups;
+    uint64_t tested = shadowCacheStats->tested;
+    uint64_t hits = shadowCacheStats->hits;
+    if (lookups > 0)
+    {
+        cout << "Shadow occluder cache: " << lookups << " shadow rays, " << tested << " tested a cached occluder first, "
+             << (tested > 0 ? 100.0 * hits / tested : 0.0) << "% hit rate (" << 100.0 * hits / lookups << "% of all shadow rays)" << endl;
+    }
+}
 
 // ShadowTrace gets the shadow value for a given ray taking into account alpha transparency
-Vector3 Scene::ShadowTrace(Ray ray, Float maxDist, vector<int>& ignoreList)
+// lightInd picks which of the thread's cached occluders to test first, -1 to not use the cache
+// firstHit is the closest hit along the ray if it's already been found
+Vector3 Scene::ShadowTrace(Ray ray, Float maxDist, vector<int>& ignoreList, int lightInd, const RayHit* firstHit)
 {
+    CountRender(COUNT_SHADOW_RAYS);
+    ShadowOccluderCache& cache = occluderCache;
+    if (lightInd >= 0 && (cache.owner != this || cache.occluders.size() != lights.size()))
+    {
+        ResetShadowCache();
+    }
+
     RayHit hit, lastHit;
     Float totalDist = 0;
     Vector3 shadowCol = Vector3::one;
+    int hint = lightInd >= 0 && cache.misses[lightInd] < ShadowOccluderCache::MAX_MISSES ? cache.occluders[lightInd] : -1;
+    bool firstLeg = true;
     while (totalDist < maxDist)
     {
-        if (Intersect(ray, hit, ignoreList))
+        bool didHit;
+        if (firstHit != nullptr)
+        {
+            // already traced as part of a packet
+            hit = *firstHit;
+            didHit = hit.hit;
+            if (lightInd >= 0)
+            {
+                cache.occluders[lightInd] = didHit && hit.t <= maxDist ? hit.shapeIndex : -1;
+            }
+            firstHit = nullptr;
+            firstLeg = false;
+        }
+        else
+        {
+            didHit = Intersect(ray, hit, ignoreList, hint);
+        }
+
+        if (firstLeg && lightInd >= 0)
+        {
+            // only count it as a hit when the cached shape really was the closest occluder
+            int occluder = didHit && hit.t <= maxDist ? hit.shapeIndex : -1;
+            cache.lookups++;
+            if (hint >= 0)
+            {
+                cache.tested++;
+                cache.hits += occluder == hint;
+                cache.misses[lightInd] = occluder == hint ? 0 : cache.misses[lightInd] + 1;
+            }
+            cache.occluders[lightInd] = occluder;
+            firstLeg = false;
+        }
+
+        // once inside a shape the next hit is usually its other side
+        hint = didHit ? hit.shapeIndex : -1;
+
+        if (didHit)
         {
             if (hit.inside)
             {
@@ -639,18 +1351,22 @@ void Scene::ApplyDepthCueing(Vector3& col, RayHit &hitInfo)
     col = col * (1 - alpha) + depthColor * alpha;
 }
 
-Vector3 Scene::SampleHDRI(Vector3 dir)
+Vector3 Scene::SampleHDRI(Ray& ray)
 {
     if (!useHDRI)
     {
         return backgroundColor;
     }
 
-    // convert to uv coordinates, with u = phi / 2pi, v = theta / pi
-    Float u = atan2(dir.z, dir.x) * 0.5 * M_1_PI + 0.5;
-    Float v = acos(dir.y) * M_1_PI;
+    // the angle between the ray and its differentials gives the filter width
+    Vector3 dir = ray.direction;
+    Float angle = 0;
+    if (ray.hasDifferentials)
+    {
+        angle = max((ray.rxDirection.normalized() - dir).magnitude(), (ray.ryDirection.normalized() - dir).magnitude());
+    }
 
-    Vector3 col = hdri->GetColorUV(u, v);    
+    Vector3 col = environment->Sample(dir, angle, ray.roughness);
     // clamp each color component to [0, 1]
     col.x = col.x > 1 ? 1 : col.x;
     col.x = col.x < 0 ? 0 : col.x;
@@ -669,5 +1385,55 @@ void Scene::InitializeBVH()
     rootBV = new BoundingVolume(shapes, 0, maxBVDepth, idealShapesPerBV);
 }
 
+bool Scene::GetBVHStats(int& nodes, vector<int>& leafDepths, vector<int>& leafSizes)
+{
+    nodes = 0;
+    leafDepths.clear();
+    leafSizes.clear();
+    if (!useBVH || rootBV == nullptr)
+    {
+        return false;
+    }
+
+    rootBV->CollectStats(nodes, leafDepths, leafSizes);
+    return true;
+}
+
+void Scene::SetLightSamples(int lightSamples)
+{
+    this->lightSamples = lightSamples;
+}
+
+int Scene::GetLightSamples()
+{
+    return lightSamples;
+}
+
+void Scene::InitializeLightBVH()
+{
+    lightBVH = make_shared<LightBVH>(lights);
+}
+
+void Scene::InitializeLightGrid()
+{
+    lightGrid = make_shared<LightGrid>(lights);
+}
+
+void Scene::InitializeAccelerators()
+{
+    if (useBVH)
+    {
+        InitializeBVH();
+    }
+    if (lightSamples > 0)
+    {
+        InitializeLightBVH();
+    }
+    else
+    {
+        InitializeLightGrid();
+    }
+}
+
 
 
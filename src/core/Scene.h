@@ -2,19 +2,44 @@
 #define SCENE_H
 
 #include "math/Vector3.h"
+#include "math/Random.h"
 #include "shapes/Shape.h"
 #include "lights/Light.h"
+#include "lights/EnvironmentLight.h"
+#include "lights/LightBVH.h"
+#include "lights/LightGrid.h"
 #include "Material.h"
 #include "BoundingVolume.h"
 #include "Image.h"
+#include "EnvironmentMap.h"
+#include "Denoiser.h"
+#include "RenderStats.h"
 
 #include <vector>
 #include <math.h>
 #include <memory>
 #include <algorithm>
+#include <atomic>
 
 using namespace std;
 
+// counts from every thread's shadow occluder cache, added in as each thread moves on to a new row
+struct ShadowCacheStats
+{
+    atomic<uint64_t> lookups{0};    // shadow rays that checked the cache
+    atomic<uint64_t> tested{0};     // ones that had an occluder cached to test first
+    atomic<uint64_t> hits{0};       // ones where that occluder really was the closest
+};
+
+// what ShadeRay works out about a hit, kept around by the wavefront integrator until the reflection and
+// refraction rays have been traced
+struct ShadingPoint
+{
+    Vector3 normal, viewDir, reflect;
+    Vector3 ambient, diffuse, specular;
+    MaterialSample material;    // the hit material's texture lookups, shared by every light
+};
+
 class Scene
 {
     public:
@@ -60,7 +85,7 @@ class Scene
         void SetUnlit(bool unlit);
         bool GetUnlit();
         void SetDepthcueing(Vector3 color, Float near, Float far, Float startAlpha, Float endAlpha);
-        void SetSoftShadows(int numSamples);
+        void SetSoftShadows(int numSamples, int numProbes = 4);    // points in the penumbra (where the probes disagree) get the full sample count
         void SetUseBVH(bool useBVH);
         bool GetUseBVH();
         void SetBVHMaxDepth(int maxDepth);
@@ -68,14 +93,30 @@ class Scene
         void SetBVHIdealShapesPerBV(int idealShapesPerBV);
         int GetBVHIdealShapesPerBV();
         void InitializeBVH();
+        bool GetBVHStats(int& nodes, vector<int>& leafDepths, vector<int>& leafSizes);  // false if there's no bvh
+        void SetLightSamples(int lightSamples);    // shading points pick this many lights from a light bvh rather than using all of them
+        int GetLightSamples();
+        void InitializeLightBVH();
+        void InitializeLightGrid();             // culls lights too far away to matter, used when not sampling a light bvh
+        void InitializeAccelerators();          // the bvh if it's enabled, and the light bvh or light grid, once the scene is loaded
         void SetHDRI(shared_ptr<Image> hdri);
         shared_ptr<Image> GetHDRI();
+        void SetEnvironmentLight(Float strength, int numSamples);  // lights the scene with the hdri, needs the hdri set first
+        void SetRoulette(Float threshold, Float cutoff = 0);      // reflection/refraction rays weighted below threshold are traced at random, below cutoff not at all
+        size_t GetTextureMemoryUsage();         // bytes used by all textures, maps and the hdri
+        void SetTextureCache(size_t memoryBudget);  // textures get paged out of core, keeping at most the budget resident
+        shared_ptr<TextureCache> GetTextureCache() { return textureCache; }
+        void ResetShadowCache();                // forgets this thread's occluders, for when it jumps to a new part of the image
+        void PrintShadowCacheStats();
 
         void AddMaterial(Material material);
+        void AddDefaultMaterial();              // used by shapes before the first mtlcolor, added before parsing
         void ClearMaterials();
         int GetNumMaterials();
+        Material& GetMaterial(int index) { return materials[index]; }
 
-        bool Intersect(Ray ray, RayHit& hitInfo, vector<int>& ignoreList);
+        bool Intersect(Ray ray, RayHit& hitInfo, vector<int>& ignoreList, int hintShape = -1);  // the hint shape gets tested first
+        void IntersectPacket(RayPacket& packet);   // incoherent packets get traced a ray at a time
 
         Vector3 GetBackgroundColor();
         void SetBackgroundColor(Vector3 color);
@@ -83,8 +124,25 @@ class Scene
         int GetNumShapes();
         shared_ptr<Shape> GetShape(int index);
 
-        Vector3 TraceRay(Ray ray, int depth, Float& dist);
-        Vector3 ShadeRay(Ray ray, RayHit hitInfo, int depth);
+        Vector3 TraceRay(Ray ray, int depth, Float& dist, SurfaceFeatures* features = nullptr);   // features gets the first hit's, for the denoiser
+        bool ShadeRay(Ray& ray, RayHit& hitInfo, int depth, ShadingPoint& sp, Vector3& color, vector<pair<int, Float>>& picks);
+
+        // the steps ShadeRay is made of, so the wavefront integrator can run each one over a whole batch of hits
+        void SetupShadingPoint(Ray& ray, RayHit& hitInfo, ShadingPoint& sp);
+        void PickLights(RayHit& hitInfo, vector<pair<int, Float>>& picks);
+        void GetColorFromLight(int lightInd, ShadingPoint& sp, Ray& ray, RayHit& hitInfo, Float weight = 1);
+        bool GetLightContribution(int lightInd, ShadingPoint& sp, Ray& ray, RayHit& hitInfo, Float weight, Vector3& lightDiffuse, Vector3& lightSpecular);
+        Vector3 GetShadow(int lightInd, RayHit& hitInfo);
+        void GetShadowPacket(int lightInd, RayHit** hitInfos, int count, Vector3* shadows);
+        void AddShadowedLight(ShadingPoint& sp, Vector3 shadowCol, Vector3 lightDiffuse, Vector3 lightSpecular);
+        void AddEnvironmentLight(ShadingPoint& sp, Ray& ray, RayHit& hitInfo);
+        Float GetFresnelRays(Ray ray, RayHit hitInfo, ShadingPoint& sp, Ray& reflRay, Ray& refrRay, bool& refraction);
+        bool SurviveRoulette(Ray& ray, Float& scale);
+        Vector3 CombineFresnel(RayHit& hitInfo, Float fr, Vector3 reflColor, Vector3 refrColor, Float refrDist, Vector3 diffuse, Float refrScale = 1);
+        Vector3 FinishShading(ShadingPoint& sp, Vector3 fresnel, RayHit& hitInfo);
+        Vector3 GetUnlitColor(RayHit& hitInfo);
+        void GetSurfaceFeatures(RayHit& hitInfo, ShadingPoint& sp, SurfaceFeatures& features);
+        Vector3 SampleHDRI(Ray& ray);
 
     private:
         vector<shared_ptr<Shape>> shapes;
@@ -94,6 +152,15 @@ class Scene
         vector<shared_ptr<Image>> bumpMaps;
         vector<shared_ptr<BWImage>> specMaps;
         shared_ptr<Image> hdri;
+        shared_ptr<EnvironmentMap> environment;     // the hdri resampled for quick lookups
+        shared_ptr<EnvironmentLight> environmentLight;
+        shared_ptr<LightBVH> lightBVH;
+        shared_ptr<LightGrid> lightGrid;
+        shared_ptr<ShadowCacheStats> shadowCacheStats = make_shared<ShadowCacheStats>();
+        int lightSamples = 0;
+        Float rouletteThreshold = 0;    // 0 = always trace both fresnel rays
+        Float rouletteCutoff = 0;
+        shared_ptr<TextureCache> textureCache;
 
         BoundingVolume *rootBV;
         Vector3 backgroundColor;
@@ -104,14 +171,16 @@ class Scene
         Vector3 depthColor = Vector3(0, 0, 0);
         Float minDepth, maxDepth, alphaMin, alphaMax;
         int shadowSamples = 1;
+        int shadowProbes = 4;
         int maxBVDepth = 5;
         int idealShapesPerBV = 4;
 
-        Vector3 GetColorFromLight(int lightInd, Vector3 reflect, Vector3 viewDir, Vector3 normal, Ray ray, RayHit hitInfo, Vector3& diffuse, Vector3& specular);
-        Vector3 GetFresnelColor(Ray ray, RayHit hitInfo, Vector3 reflct, Vector3 viewDir, Vector3 normal, Vector3 diffuse, int depth);
+        Vector3 GetColorFromEnvironment(ShadingPoint& sp, Ray ray, RayHit hitInfo);
         void ApplyDepthCueing(Vector3 &color, RayHit &hitInfo);
-        Vector3 SampleHDRI(Vector3 dir);
-        Vector3 ShadowTrace(Ray ray, Float maxDist, vector<int>& ignoreList);
+        void SetReflectedDifferentials(Ray& ray, RayHit& hitInfo, Vector3 normal, Vector3 dndx, Vector3 dndy, Ray& reflRay);
+        void SetRefractedDifferentials(Ray& ray, RayHit& hitInfo, Vector3 normal, Vector3 dndx, Vector3 dndy, Float eta, Ray& refrRay);
+        Vector3 ShadowTrace(Ray ray, Float maxDist, vector<int>& ignoreList, int lightInd = -1, const RayHit* firstHit = nullptr);
+        Vector3 SoftShadowTrace(int lightInd, Vector3 point, vector<int>& ignoreList);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "TexelBuffer.h"
+
+#include <cstring>
+
+// lookup table for converting 8 bit values back to floats
+static struct U8Table
+{
+    float values[256];
+
+    U8Table()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            values[i] = i / 255.0f;
+        }
+    }
+} u8ToFloat;
+
+TexelBuffer::TexelBuffer()
+{
+    width = 0;
+    height = 0;
+    channels = 0;
+    storedChannels = 0;
+    bytesPerTexel = 0;
+    blocksX = 0;
+    format = TEXEL_FLOAT;
+    texels = nullptr;
+}
+
+void TexelBuffer::Allocate(int width, int height, int channels, TexelFormat format)
+{
+    this->width = width;
+    this->height = height;
+    this->channels = channels;
+    this->format = format;
+
+    storedChannels = (channels == 3 && format != TEXEL_FLOAT) ? 4 : channels;
+    int bytesPerChannel = format == TEXEL_U8 ? 1 : (format == TEXEL_HALF ? 2 : 4);
+    bytesPerTexel = storedChannels * bytesPerChannel;
+
+    // round the dimensions up to whole blocks
+    blocksX = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int blocksY = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t size = (size_t) blocksX * blocksY * BLOCK_SIZE * BLOCK_SIZE * bytesPerTexel;
+
+    // over allocate so the texels can start on a cache line
+    data.assign(size + 63, 0);
+    texels = data.data() + ((64 - ((uintptr_t) data.data() & 63)) & 63);
+}
+
+void TexelBuffer::Clear()
+{
+    data.clear();
+    data.shrink_to_fit();
+    texels = nullptr;
+    width = height = 0;
+}
+
+void TexelBuffer::ReleaseTexels()
+{
+    data.clear();
+    data.shrink_to_fit();
+    texels = nullptr;
+}
+
+int TexelBuffer::GetNumBlocks() const
+{
+    return blocksX * ((height + BLOCK_SIZE - 1) / BLOCK_SIZE);
+}
+
+inline size_t TexelBuffer::GetOffsetInBlock(int x, int y) const
+{
+    const int tilesPerBlock = BLOCK_SIZE / TILE_SIZE;
+
+    int tile = ((y % BLOCK_SIZE) / TILE_SIZE) * tilesPerBlock + (x % BLOCK_SIZE) / TILE_SIZE;
+    int texel = (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+
+    return (tile * TILE_SIZE * TILE_SIZE + texel) * bytesPerTexel;
+}
+
+void TexelBuffer::SetTexel(int x, int y, const float* values)
+{
+    unsigned char* texel = texels + GetBlockIndex(x, y) * GetBlockBytes() + GetOffsetInBlock(x, y);
+
+    switch (format)
+    {
+        case TEXEL_U8:
+            for (int i = 0; i < channels; i++)
+            {
+                float v = values[i] < 0 ? 0 : (values[i] > 1 ? 1 : values[i]);
+                texel[i] = (unsigned char) (v * 255.0f + 0.5f);
+            }
+            break;
+        case TEXEL_HALF:
+            for (int i = 0; i < channels; i++)
+            {
+                uint16_t h = FloatToHalf(values[i]);
+                memcpy(texel + 2 * i, &h, sizeof(uint16_t));
+            }
+            break;
+        case TEXEL_FLOAT:
+            memcpy(texel, values, channels * sizeof(float));
+            break;
+    }
+}
+
+void TexelBuffer::GetTexel(int x, int y, float* values) const
+{
+    DecodeTexel(GetBlock(GetBlockIndex(x, y)), x, y, values);
+}
+
+// x and y are in image space, only their position within the block is used
+void TexelBuffer::DecodeTexel(const unsigned char* block, int x, int y, float* values) const
+{
+    const unsigned char* texel = block + GetOffsetInBlock(x, y);
+
+    switch (format)
+    {
+        case TEXEL_U8:
+            for (int i = 0; i < channels; i++)
+            {
+                values[i] = u8ToFloat.values[texel[i]];
+            }
+            break;
+        case TEXEL_HALF:
+            for (int i = 0; i < channels; i++)
+            {
+                uint16_t h;
+                memcpy(&h, texel + 2 * i, sizeof(uint16_t));
+                values[i] = HalfToFloat(h);
+            }
+            break;
+        case TEXEL_FLOAT:
+            memcpy(values, texel, channels * sizeof(float));
+            break;
+    }
+}
+
+// conversions between ieee 754 single and half precision, values too big for a half become infinity
+// and values too small become zero (we don't bother with half denormals)
+uint16_t TexelBuffer::FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int) ((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff)
+    {
+        // inf or nan
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+    if (exponent >= 31)
+    {
+        return sign | 0x7c00;
+    }
+    if (exponent <= 0)
+    {
+        return sign;
+    }
+
+    // round to nearest
+    uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+    {
+        half++;
+    }
+    return half;
+}
+
+float TexelBuffer::HalfToFloat(uint16_t value)
+{
+    uint32_t sign = (uint32_t) (value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 0)
+    {
+        bits = sign;
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#ifndef TEXELBUFFER_H
+#define TEXELBUFFER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// precision each channel is stored at, textures keep whatever precision their source file had
+enum TexelFormat
+{
+    TEXEL_U8,       // 8 bit unorm, for ldr images
+    TEXEL_HALF,     // 16 bit float, for 16 bit images
+    TEXEL_FLOAT     // 32 bit float, for hdr images and render targets
+};
+
+// Storage for the texels of an image. Rather than storing rows, texels are grouped into 4x4 tiles so a
+// bilinear lookup usually only touches one or two cache lines, and the tiles are grouped into 32x32 texel
+// blocks so nearby lookups also stay on the same few pages.
+class TexelBuffer
+{
+    public:
+        static const int TILE_SIZE = 4;
+        static const int BLOCK_SIZE = 32;
+
+        TexelBuffer();
+
+        void Allocate(int width, int height, int channels, TexelFormat format);
+        void Clear();
+
+        void SetTexel(int x, int y, const float* values);
+        void GetTexel(int x, int y, float* values) const;
+
+        // block level access, used by the texture cache to page blocks in and out
+        int GetNumBlocks() const;
+        int GetBlockIndex(int x, int y) const { return (y / BLOCK_SIZE) * blocksX + x / BLOCK_SIZE; }
+        size_t GetBlockBytes() const { return (size_t) BLOCK_SIZE * BLOCK_SIZE * bytesPerTexel; }
+        const unsigned char* GetBlock(int block) const { return texels + block * GetBlockBytes(); }
+        void DecodeTexel(const unsigned char* block, int x, int y, float* values) const;
+        void ReleaseTexels();   // frees the texels but keeps the layout, for textures that moved into the cache
+
+        int GetWidth() const { return width; }
+        int GetHeight() const { return height; }
+        int GetChannels() const { return channels; }
+        TexelFormat GetFormat() const { return format; }
+        size_t GetMemoryUsage() const { return data.size(); }
+
+        static uint16_t FloatToHalf(float value);
+        static float HalfToFloat(uint16_t value);
+
+    private:
+        int width;
+        int height;
+        int channels;
+        int storedChannels;     // 3 channel u8/half texels get padded to 4 so tiles line up with cache lines
+        int bytesPerTexel;
+        int blocksX;
+        TexelFormat format;
+        vector<unsigned char> data;
+        unsigned char* texels;  // data aligned to a cache line
+
+        size_t GetOffsetInBlock(int x, int y) const;
+};
+
+#endif
\ No newline at end of file
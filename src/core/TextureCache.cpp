@@ -0,0 +1,227 @@
+#include "TextureCache.h"
+
+#include <iostream>
+#include <unistd.h>
+
+static atomic<int> nextCacheID(0);
+
+// small direct mapped cache of the last tiles a thread used, holding a reference to each tile which
+// pins it in the shared cache until the slot gets reused
+struct TileLookupCache
+{
+    static const int SIZE = 64;     // power of 2, neighbouring blocks have neighbouring ids so rarely collide
+    static const int FLUSH_INTERVAL = 1 << 16;
+
+    int owner = -1;
+    int mask = SIZE - 1;            // the owner's lookup size - 1
+    int tiles[SIZE];
+    shared_ptr<vector<unsigned char>> data[SIZE];
+    shared_ptr<TextureCacheStats> stats;
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+
+    ~TileLookupCache()
+    {
+        Flush();
+    }
+
+    void Flush()
+    {
+        if (stats != nullptr)
+        {
+            stats->lookups += lookups;
+            stats->threadHits += hits;
+        }
+        lookups = 0;
+        hits = 0;
+    }
+
+    void Reset(TextureCache* cache)
+    {
+        Flush();
+        owner = cache->id;
+        mask = cache->lookupSize - 1;
+        stats = cache->stats;
+        for (int i = 0; i < SIZE; i++)
+        {
+            tiles[i] = -1;
+            data[i] = nullptr;
+        }
+    }
+};
+
+static thread_local TileLookupCache lookupCache;
+
+TextureCache::TextureCache(size_t memoryBudget)
+{
+    id = nextCacheID++;
+    this->memoryBudget = memoryBudget;
+    stats = make_shared<TextureCacheStats>();
+
+    // tmpfile gets removed automatically once it's closed
+    backingFile = tmpfile();
+    if (backingFile == nullptr)
+    {
+        cout << "Error: Could not create texture cache backing file" << endl;
+    }
+}
+
+TextureCache::~TextureCache()
+{
+    if (backingFile != nullptr)
+    {
+        fclose(backingFile);
+    }
+}
+
+// writes every block out to the backing file, should only be called while loading the scene
+int TextureCache::AddTexels(const TexelBuffer& texels)
+{
+    int firstTile = tiles.size();
+    size_t blockBytes = texels.GetBlockBytes();
+
+    for (int i = 0; i < texels.GetNumBlocks(); i++)
+    {
+        TileInfo info;
+        info.offset = backingSize;
+        info.size = blockBytes;
+
+        if (backingFile == nullptr || fwrite(texels.GetBlock(i), 1, blockBytes, backingFile) != blockBytes)
+        {
+            cout << "Error: Could not write to texture cache backing file" << endl;
+        }
+
+        backingSize += blockBytes;
+        tiles.push_back(info);
+    }
+    maxBlockBytes = max(maxBlockBytes, blockBytes);
+
+    if (backingFile != nullptr)
+    {
+        fflush(backingFile);
+    }
+    return firstTile;
+}
+
+// the tiles the lookup caches hold can't be evicted, so keep them to at most half the budget when
+// every thread's cache is full of the largest tiles
+void TextureCache::SetThreads(unsigned int threads)
+{
+    this->threads = max(1u, threads);
+    lookupSize = TileLookupCache::SIZE;
+    while (lookupSize > 1 && lookupSize * maxBlockBytes * this->threads > memoryBudget / 2)
+    {
+        lookupSize /= 2;
+    }
+}
+
+const unsigned char* TextureCache::GetTile(int tile)
+{
+    TileLookupCache& local = lookupCache;
+    if (local.owner != id)
+    {
+        local.Reset(this);
+    }
+
+    local.lookups++;
+    int slot = tile & local.mask;
+    if (local.tiles[slot] == tile)
+    {
+        local.hits++;
+        return local.data[slot]->data();
+    }
+
+    local.data[slot] = LoadTile(tile);
+    local.tiles[slot] = tile;
+
+    if (local.lookups >= TileLookupCache::FLUSH_INTERVAL)
+    {
+        local.Flush();
+    }
+
+    return local.data[slot]->data();
+}
+
+shared_ptr<vector<unsigned char>> TextureCache::LoadTile(int tile)
+{
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        auto found = residentTiles.find(tile);
+        if (found != residentTiles.end())
+        {
+            lru.splice(lru.begin(), lru, found->second);
+            stats->cacheHits++;
+            return found->second->data;
+        }
+    }
+
+    // read outside the lock so other threads can keep using resident tiles
+    const TileInfo& info = tiles[tile];
+    shared_ptr<vector<unsigned char>> data = make_shared<vector<unsigned char>>(info.size);
+    if (backingFile == nullptr || pread(fileno(backingFile), data->data(), info.size, info.offset) != (ssize_t) info.size)
+    {
+        cout << "Error: Could not read tile " << tile << " from texture cache backing file" << endl;
+    }
+
+    lock_guard<mutex> lock(cacheMutex);
+
+    // another thread may have read the same tile in the meantime
+    auto found = residentTiles.find(tile);
+    if (found != residentTiles.end())
+    {
+        lru.splice(lru.begin(), lru, found->second);
+        return found->second->data;
+    }
+
+    lru.push_front({ tile, data });
+    residentTiles[tile] = lru.begin();
+    memoryUsed += info.size;
+    stats->tilesRead++;
+
+    // evict the least recently used tiles no lookup cache is holding, which also keeps the one we just
+    // read. references to tiles are only handed out under the lock, so a tile that isn't pinned here
+    // can't become pinned before it's gone
+    auto oldest = lru.end();
+    while (memoryUsed > memoryBudget && oldest != lru.begin())
+    {
+        --oldest;
+        if (oldest->IsPinned())
+        {
+            continue;
+        }
+
+        memoryUsed -= oldest->data->size();
+        residentTiles.erase(oldest->tile);
+        oldest = lru.erase(oldest);
+        stats->evictions++;
+    }
+
+    peakMemoryUsed = max(peakMemoryUsed, memoryUsed);
+    return data;
+}
+
+// should be called after the render threads have finished, so their lookup counts have been flushed
+void TextureCache::PrintStats()
+{
+    lookupCache.Flush();
+
+    uint64_t lookups = stats->lookups;
+    uint64_t threadHits = stats->threadHits;
+    uint64_t cacheHits = stats->cacheHits;
+    uint64_t tilesRead = stats->tilesRead;
+    uint64_t sharedLookups = lookups - threadHits;
+
+    cout << "Texture cache: " << lookups << " lookups, " << tiles.size() << " tiles ("
+         << backingSize / (1024.0 * 1024.0) << " MB on disk, budget " << memoryBudget / (1024.0 * 1024.0) << " MB)" << endl;
+    if (lookups > 0)
+    {
+        cout << "  thread cache hit rate: " << 100.0 * threadHits / lookups << "%" << endl;
+    }
+    if (sharedLookups > 0)
+    {
+        cout << "  shared cache hit rate: " << 100.0 * cacheHits / sharedLookups << "%" << endl;
+    }
+    cout << "  overall hit rate: " << (lookups > 0 ? 100.0 * (lookups - tilesRead) / lookups : 100.0) << "%, "
+         << tilesRead << " tiles read, " << stats->evictions << " evicted, peak resident "
+         << peakMemoryUsed / (1024.0 * 1024.0) << " MB (including tiles held by threads, " << lookupSize << " per thread)" << endl;
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include "TexelBuffer.h"
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+
+using namespace std;
+
+// counters shared between the cache and the per thread lookup caches, kept separate from the cache so
+// threads can still flush their counts into it safely
+struct TextureCacheStats
+{
+    atomic<uint64_t> lookups;
+    atomic<uint64_t> threadHits;    // found in the thread's own lookup cache
+    atomic<uint64_t> cacheHits;     // found resident in the shared cache
+    atomic<uint64_t> tilesRead;     // had to be paged in from the backing file
+    atomic<uint64_t> evictions;
+
+    TextureCacheStats() : lookups(0), threadHits(0), cacheHits(0), tilesRead(0), evictions(0) {}
+};
+
+// Out of core storage for texture tiles (the 32x32 blocks of a TexelBuffer). Textures handed to the cache
+// get their blocks written to a backing file and their texels freed, then blocks are paged back in on
+// first access and kept resident under a memory budget, evicting the least recently used ones.
+// Each thread also keeps a small lookup cache of the tiles it used last, so most lookups never touch
+// the shared cache's lock. Tiles held by a lookup cache stay resident and count against the budget,
+// and the lookup caches are sized so they can only take up part of it.
+class TextureCache
+{
+    public:
+        TextureCache(size_t memoryBudget);
+        ~TextureCache();
+
+        int AddTexels(const TexelBuffer& texels);   // returns the id of the first block's tile
+        const unsigned char* GetTile(int tile);     // only valid until the calling thread's next lookup
+        void SetThreads(unsigned int threads);      // sizes the lookup caches, call before rendering
+
+        size_t GetMemoryBudget() { return memoryBudget; }
+        size_t GetBackingSize() { return backingSize; }
+        void PrintStats();
+
+    private:
+        struct TileInfo
+        {
+            long offset;    // position in the backing file
+            size_t size;
+        };
+
+        struct ResidentTile
+        {
+            int tile;
+            shared_ptr<vector<unsigned char>> data;     // also held by the lookup caches using the tile
+
+            bool IsPinned() { return data.use_count() > 1; }
+        };
+
+        int id;             // tells apart caches in the thread lookup caches
+        int lookupSize = 64;    // slots in each thread's lookup cache, a power of 2
+        unsigned int threads = 1;
+        size_t maxBlockBytes = 0;
+        size_t memoryBudget;
+        size_t memoryUsed = 0;
+        size_t peakMemoryUsed = 0;
+        size_t backingSize = 0;
+        FILE* backingFile;
+        vector<TileInfo> tiles;
+
+        mutex cacheMutex;
+        list<ResidentTile> lru;     // most recently used at the front
+        unordered_map<int, list<ResidentTile>::iterator> residentTiles;
+        shared_ptr<TextureCacheStats> stats;
+
+        shared_ptr<vector<unsigned char>> LoadTile(int tile);
+
+        friend struct TileLookupCache;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "Trace.h"
+#include "ext/json.h"
+
+#include <iostream>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+
+using json = nlohmann::json;
+
+struct TraceEvent
+{
+    const char* name;
+    const char* category;
+    const char* argName;
+    int argValue;
+    double start;
+    double duration;
+};
+
+bool Trace::enabled = false;
+
+static chrono::steady_clock::time_point traceStart;
+static atomic<int> nextThreadID(0);
+static mutex eventsMutex;
+static vector<pair<int, vector<TraceEvent>>> finishedEvents;  // handed over by each thread as it exits
+
+// a thread's events, given to finishedEvents when the thread exits (or the trace is saved)
+struct ThreadTraceBuffer
+{
+    int id = nextThreadID++;
+    vector<TraceEvent> events;
+
+    ~ThreadTraceBuffer()
+    {
+        Flush();
+    }
+
+    void Flush()
+    {
+        if (events.empty())
+        {
+            return;
+        }
+        lock_guard<mutex> lock(eventsMutex);
+        finishedEvents.push_back(make_pair(id, events));
+        events.clear();
+    }
+};
+
+static ThreadTraceBuffer& GetThreadBuffer()
+{
+    static thread_local ThreadTraceBuffer buffer;
+    return buffer;
+}
+
+void Trace::Enable()
+{
+    traceStart = chrono::steady_clock::now();
+    enabled = true;
+
+    // makes sure the thread enabling tracing (the main one) gets id 0
+    GetThreadBuffer();
+}
+
+double Trace::Now()
+{
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - traceStart).count();
+}
+
+void Trace::AddEvent(const char* name, const char* category, double start, double end, const char* argName, int argValue)
+{
+    GetThreadBuffer().events.push_back({ name, category, argName, argValue, start, end - start });
+}
+
+int Trace::SaveToFileJSON(string fileName)
+{
+    GetThreadBuffer().Flush();
+
+    json events = json::array();
+    lock_guard<mutex> lock(eventsMutex);
+    vector<bool> named(nextThreadID, false);
+    for (int i = 0; i < finishedEvents.size(); i++)
+    {
+        int tid = finishedEvents[i].first;
+        if (!named[tid])
+        {
+            // metadata event so the viewer labels the thread's track
+            named[tid] = true;
+            string threadName = tid == 0 ? "main" : "thread " + to_string(tid);
+            events.push_back({ { "name", "thread_name" }, { "ph", "M" }, { "pid", 1 }, { "tid", tid }, { "args", { { "name", threadName } } } });
+        }
+
+        for (const TraceEvent& event : finishedEvents[i].second)
+        {
+            json entry = { { "name", event.name }, { "cat", event.category }, { "ph", "X" }, { "ts", event.start },
+                           { "dur", event.duration }, { "pid", 1 }, { "tid", tid } };
+            if (event.argName != nullptr)
+            {
+                entry["args"] = { { event.argName, event.argValue } };
+            }
+            events.push_back(entry);
+        }
+    }
+
+    ofstream file(fileName.c_str());
+    if (!file.is_open())
+    {
+        cout << "Error: Could not open file " << fileName << endl;
+        return 1;
+    }
+
+    file << json({ { "traceEvents", events }, { "displayTimeUnit", "ms" } }).dump() << endl;
+    file.close();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+using namespace std;
+
+// A timeline of what each thread was doing, written as a chrome trace (json with one complete event per
+// timed scope) that loads in chrome://tracing or ui.perfetto.dev. Each thread keeps its events in its
+// own buffer and hands them over when it exits, so recording never takes a lock. Tracing has to be
+// enabled before any threads start, and while it's off a scoped trace only checks a flag.
+class Trace
+{
+    public:
+        static void Enable();
+        static bool IsEnabled() { return enabled; }
+
+        // should be called after the other threads have finished, so their events have been handed over
+        static int SaveToFileJSON(string fileName);
+
+        static double Now();    // microseconds since tracing was enabled
+        static void AddEvent(const char* name, const char* category, double start, double end, const char* argName = nullptr, int argValue = 0);
+
+    private:
+        static bool enabled;
+};
+
+// records the time between its construction and destruction as an event. the strings should be literals,
+// since they're only copied out when the trace is saved
+class ScopedTrace
+{
+    public:
+        ScopedTrace(const char* name, const char* category, const char* argName = nullptr, int argValue = 0)
+        {
+            active = Trace::IsEnabled();
+            if (active)
+            {
+                this->name = name;
+                this->category = category;
+                this->argName = argName;
+                this->argValue = argValue;
+                start = Trace::Now();
+            }
+        }
+
+        ~ScopedTrace()
+        {
+            if (active)
+            {
+                Trace::AddEvent(name, category, start, Trace::Now(), argName, argValue);
+            }
+        }
+
+    private:
+        bool active;
+        const char* name;
+        const char* category;
+        const char* argName;
+        int argValue;
+        double start;
+};
+
+#endif
\ No newline at end of file
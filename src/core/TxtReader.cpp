@@ -94,6 +94,12 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
         command = args[0];
         args.erase(args.begin());
 
+        // these don't change the image, so a checkpoint can still be resumed after changing them
+        if (command != "threads" && command != "checkpoint" && command != "texturecache")
+        {
+            camera.GetCheckpoint().AddSceneCommand(command, args);
+        }
+
         // now check the command
         if (command == "imsize")
         {
@@ -179,19 +185,26 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
         }
         else if (command == "mtlcolor")
         {
-            if (args.size() != 12)
+            if (args.size() != 10 && args.size() != 12 && args.size() != 13)
             {
                 cout << "ERROR on line " << line_num << ": Improper material usage: material <diff_r> <diff_g> <diff_b> <spec_r> <spec_g> " <<
-                                                           "<spec_b> <ambient> <diffuse> <specular> <spec_falloff> <alpha> <ior>\n";
+                                                           "<spec_b> <ambient> <diffuse> <specular> <spec_falloff> [<alpha> <ior> [roughness]]\n";
                 return 1;
             }
 
+            // older scene files (like the ones in hw1c and oldInputs) leave out alpha and ior, so are opaque
             x = stof(args[0]); y = stof(args[1]); z = stof(args[2]);
             dx = stof(args[3]); dy = stof(args[4]); dz = stof(args[5]);
             ka = stof(args[6]); kd = stof(args[7]); ks = stof(args[8]);
-            n = stof(args[9]); alpha = stof(args[10]); ior = stof(args[11]);
+            n = stof(args[9]);
+            alpha = args.size() > 10 ? stof(args[10]) : 1;
+            ior = args.size() > 10 ? stof(args[11]) : 1;
 
             Material mat = Material(Vector3(x, y, z), Vector3(dx, dy, dz), ka, kd, ks, n, alpha, ior);
+            if (args.size() == 13)
+            {
+                mat.SetRoughness(stof(args[12]));
+            }
 
             scene.AddMaterial(mat);
         }
@@ -376,6 +389,57 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
             // idk what w is far, since it doesn't make sense to have a directional attenuated light :/
             scene.AddLight(light);
         }
+        else if (command == "arealight")
+        {
+            if (args.size() != 12 && args.size() != 15)
+            {
+                cout << "ERROR on line " << line_num << ": Improper arealight usage: arealight <disk|rect|sphere> <x> <y> <z> <nx> <ny> <nz> <width> <height> <r> <g> <b> [<c1> <c2> <c3>]\n";
+                return 1;
+            }
+
+            AreaShape areaShape;
+            if (args[0] == "disk")
+            {
+                areaShape = AREA_DISK;
+            }
+            else if (args[0] == "rect")
+            {
+                areaShape = AREA_RECT;
+            }
+            else if (args[0] == "sphere")
+            {
+                areaShape = AREA_SPHERE;
+            }
+            else
+            {
+                cout << "ERROR on line " << line_num << ": Unknown area light shape " << args[0] << ", should be disk, rect or sphere" << endl;
+                return 1;
+            }
+
+            x = stof(args[1]); y = stof(args[2]); z = stof(args[3]);
+            dx = stof(args[4]); dy = stof(args[5]); dz = stof(args[6]);
+            w = stof(args[7]); h = stof(args[8]);
+            r = stof(args[9]); g = stof(args[10]); b = stof(args[11]);
+            c1 = 1; c2 = 0; c3 = 0;
+            if (args.size() == 15)
+            {
+                c1 = stof(args[12]); c2 = stof(args[13]); c3 = stof(args[14]);
+            }
+
+            if (w <= 0 || (areaShape == AREA_RECT && h <= 0))
+            {
+                cout << "ERROR on line " << line_num << ": Area lights need a positive size" << endl;
+                return 1;
+            }
+            if (areaShape != AREA_SPHERE && Vector3(dx, dy, dz).sqrMagnitude() == 0)
+            {
+                cout << "ERROR on line " << line_num << ": Disk and rect area lights need a normal" << endl;
+                return 1;
+            }
+
+            light = make_shared<AreaLight>(areaShape, Vector3(x, y, z), Vector3(dx, dy, dz), w, h, Vector3(r, g, b), c1, c2, c3);
+            scene.AddLight(light);
+        }
         else if (command == "depthcueing")
         {
             if (args.size() != 7)
@@ -392,15 +456,16 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
         }
         else if (command == "shadowSamples")
         {
-            if (args.size() != 1)
+            if (args.size() != 1 && args.size() != 2)
             {
-                cout << "ERROR on line " << line_num << ": Improper shadowSamples usage: shadowSamples <num_samples>\n";
+                cout << "ERROR on line " << line_num << ": Improper shadowSamples usage: shadowSamples <num_samples> [<num_probes>]\n";
                 return 1;
             }
 
             x = stof(args[0]);
 
-            scene.SetSoftShadows(x);
+            // probes are traced first, and the rest of the samples only if they disagree (0 turns this off)
+            scene.SetSoftShadows(x, args.size() == 2 ? stoi(args[1]) : 4);
         }
         else if (command == "unlit")
         {
@@ -454,6 +519,152 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
 
             camera.SetNumSamples((unsigned int)x);
         }
+        else if (command == "wavefront")
+        {
+            if (args.size() != 1)
+            {
+                cout << "ERROR on line " << line_num << ": Improper wavefront usage: wavefront <rays_per_batch>\n";
+                return 1;
+            }
+
+            x = stof(args[0]);
+
+            if (x < 0)
+            {
+                cout << "WARNING: rays_per_batch can't be negative, setting to 0 (depth first)\n";
+                x = 0;
+            }
+
+            camera.SetWavefrontBatch((unsigned int)x);
+        }
+        else if (command == "packets")
+        {
+            if (args.size() != 1)
+            {
+                cout << "ERROR on line " << line_num << ": Improper packets usage: packets <rays_per_packet>\n";
+                return 1;
+            }
+
+            int size = stoi(args[0]);
+            if (size < 0 || size > RayPacket::MAX_SIZE)
+            {
+                cout << "ERROR on line " << line_num << ": rays_per_packet should be between 0 and " << (int) RayPacket::MAX_SIZE << endl;
+                return 1;
+            }
+
+            camera.SetPacketSize(size);
+        }
+        else if (command == "reorder")
+        {
+            if (args.size() != 0)
+            {
+                cout << "ERROR on line " << line_num << ": Improper reorder usage: reorder\n";
+                return 1;
+            }
+
+            camera.SetReorderRays(true);
+        }
+        else if (command == "denoise")
+        {
+            if (args.size() != 1)
+            {
+                cout << "ERROR on line " << line_num << ": Improper denoise usage: denoise <passes>\n";
+                return 1;
+            }
+
+            int passes = stoi(args[0]);
+            if (passes < 0 || passes > 10)
+            {
+                cout << "ERROR on line " << line_num << ": denoise passes should be between 0 and 10\n";
+                return 1;
+            }
+
+            camera.SetDenoisePasses(passes);
+        }
+        else if (command == "heatmap")
+        {
+            if (args.size() < 1 || args.size() > 2)
+            {
+                cout << "ERROR on line " << line_num << ": Improper heatmap usage: heatmap <filename> [<metric>]\n";
+                return 1;
+            }
+
+            camera.SetHeatmapFile(args[0]);
+            if (args.size() == 2)
+            {
+                int metric = CostHeatmap::ParseMetric(args[1]);
+                if (metric < 0)
+                {
+                    cout << "ERROR on line " << line_num << ": Unknown heatmap metric " << args[1]
+                         << ", should be one of rays, shadowrays, nodes, tests or cost\n";
+                    return 1;
+                }
+                camera.GetHeatmap().SetMetric((CostHeatmap::Metric) metric);
+            }
+        }
+        else if (command == "aov")
+        {
+            if (args.size() < 1)
+            {
+                cout << "ERROR on line " << line_num << ": Improper aov usage: aov <filename> [<layer> ...]\n";
+                return 1;
+            }
+
+            camera.SetAOVFile(args[0]);
+
+            // every layer if none are listed
+            if (args.size() == 1)
+            {
+                camera.AddAllAOVs();
+            }
+            for (int i = 1; i < args.size(); i++)
+            {
+                if (!camera.AddAOV(args[i]))
+                {
+                    cout << "ERROR on line " << line_num << ": Unknown aov layer " << args[i]
+                         << ", should be one of " << Camera::GetAOVNames() << "\n";
+                    return 1;
+                }
+            }
+        }
+        else if (command == "checkpoint")
+        {
+            if (args.size() < 1 || args.size() > 2)
+            {
+                cout << "ERROR on line " << line_num << ": Improper checkpoint usage: checkpoint <filename> [<interval_seconds>]\n";
+                return 1;
+            }
+
+            camera.SetCheckpointFile(args[0]);
+            if (args.size() == 2)
+            {
+                Float interval = stof(args[1]);
+                if (interval <= 0)
+                {
+                    cout << "ERROR on line " << line_num << ": checkpoint interval must be positive\n";
+                    return 1;
+                }
+                camera.SetCheckpointInterval(interval);
+            }
+        }
+        else if (command == "roulette")
+        {
+            if (args.size() < 1 || args.size() > 2)
+            {
+                cout << "ERROR on line " << line_num << ": Improper roulette usage: roulette <threshold> [<cutoff>]\n";
+                return 1;
+            }
+
+            Float threshold = stof(args[0]);
+            Float cutoff = args.size() > 1 ? stof(args[1]) : 0;
+            if (threshold < 0 || cutoff < 0 || cutoff > threshold)
+            {
+                cout << "ERROR on line " << line_num << ": roulette needs 0 <= cutoff <= threshold\n";
+                return 1;
+            }
+
+            scene.SetRoulette(threshold, cutoff);
+        }
         else if (command == "bounces")
         {
             if (args.size() != 1)
@@ -485,6 +696,44 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
             scene.SetBVHIdealShapesPerBV(4); // should maybe make this a parameter as well...
             scene.SetUseBVH(true);
         }
+        else if (command == "lightbvh")
+        {
+            if (args.size() != 1)
+            {
+                cout << "ERROR on line " << line_num << ": Improper lightbvh usage: lightbvh <samples>\n";
+                return 1;
+            }
+
+            int samples = stoi(args[0]);
+            if (samples < 1)
+            {
+                cout << "WARNING: lightbvh needs at least 1 sample, setting to 1\n";
+                samples = 1;
+            }
+
+            scene.SetLightSamples(samples);
+        }
+        else if (command == "texturecache")
+        {
+            if (args.size() != 1)
+            {
+                cout << "ERROR on line " << line_num << ": Improper texturecache usage: texturecache <budget_mb>\n";
+                return 1;
+            }
+
+            x = stof(args[0]);
+            if (x <= 0)
+            {
+                cout << "ERROR on line " << line_num << ": texture cache budget must be greater than 0\n";
+                return 1;
+            }
+            if (scene.GetTextureCache() != nullptr)
+            {
+                cout << "WARNING: texture cache already set up, ignoring new budget\n";
+            }
+
+            scene.SetTextureCache((size_t) (x * 1024 * 1024));
+        }
         else if (command == "texture")
         {
             if (args.size() != 1)
@@ -515,6 +764,7 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
             }
             
             scene.AddTexture(tex);
+            camera.GetCheckpoint().AddInputFile(args[0]);
         }
         else if (command == "bump")
         {
@@ -544,6 +794,7 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
             }
 
             scene.AddBumpMap(tex);
+            camera.GetCheckpoint().AddInputFile(args[0]);
         }
         else if (command == "obj")
         {
@@ -558,6 +809,7 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
                 cout << "ERROR on line " << line_num << ": Could not load obj file " << args[0] << endl;
                 return 1;
             }
+            camera.GetCheckpoint().AddInputFile(args[0]);
         }
         else if (command == "gltf")
         {
@@ -572,6 +824,7 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
                 cout << "ERROR on line " << line_num << ": Could not load gltf file " << args[0] << endl;
                 return 1;
             }
+            camera.GetCheckpoint().AddInputFile(args[0]);
         }
         else if (command == "ior")
         {
@@ -618,6 +871,30 @@ int TxtReader::parseInput(string filename, Scene& scene, Camera& camera)
             }
 
             scene.SetHDRI(hdri);
+            camera.GetCheckpoint().AddInputFile(args[0]);
+        }
+        else if (command == "hdrilight")
+        {
+            if (args.size() != 2)
+            {
+                cout << "ERROR on line " << line_num << ": Improper hdrilight usage: hdrilight <strength> <samples>\n";
+                return 1;
+            }
+            if (scene.GetHDRI() == nullptr)
+            {
+                cout << "ERROR on line " << line_num << ": hdrilight needs an hdri to be set first\n";
+                return 1;
+            }
+
+            x = stof(args[0]);
+            int samples = stoi(args[1]);
+            if (samples < 1)
+            {
+                cout << "WARNING: hdrilight needs at least 1 sample, setting to 1\n";
+                samples = 1;
+            }
+
+            scene.SetEnvironmentLight(x, samples);
         }
         else if (command != "")
         {
@@ -0,0 +1,382 @@
+#include "WavefrontIntegrator.h"
+
+#include <algorithm>
+
+WavefrontIntegrator::WavefrontIntegrator(Scene& scene, int packetSize, bool reorder) : scene(scene)
+{
+    this->packetSize = min(packetSize, (int) RayPacket::MAX_SIZE);
+    this->reorder = reorder;
+}
+
+// spreads the bottom 10 bits out so there are two zero bits between each of them
+static uint64_t SpreadBits(uint64_t v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x30000ff;
+    v = (v | (v << 8)) & 0x300f00f;
+    v = (v | (v << 4)) & 0x30c30c3;
+    v = (v | (v << 2)) & 0x9249249;
+    return v;
+}
+
+// same for the bottom 16 bits with one zero bit between each
+static uint64_t SpreadBits2D(uint64_t v)
+{
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0xff00ff;
+    v = (v | (v << 4)) & 0xf0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+void WavefrontIntegrator::Trace(vector<Ray>& cameraRays, int depth, vector<Vector3>& outColors, vector<SurfaceFeatures>* features)
+{
+    rays.clear();
+    hits.clear();
+    dists.clear();
+    depths.clear();
+    states.clear();
+    points.clear();
+    fresnel.clear();
+    reflChildren.clear();
+    refrChildren.clear();
+    reflScales.clear();
+    refrScales.clear();
+    colors.clear();
+
+    for (int i = 0; i < cameraRays.size(); i++)
+    {
+        AddRay(cameraRays[i], depth);
+    }
+    CountRender(COUNT_CAMERA_RAYS, cameraRays.size());
+
+    // each pass handles one bounce, and shading queues up the rays for the next one
+    int start = 0;
+    while (start < rays.size())
+    {
+        int end = rays.size();
+        ReorderStage(start, end);
+        IntersectStage(start, end);
+        SortStage(start, end);
+        ShadeStage();
+        ShadowStage();
+        EnvironmentStage();
+        start = end;
+    }
+
+    CombineStage();
+
+    outColors.resize(cameraRays.size());
+    for (int i = 0; i < cameraRays.size(); i++)
+    {
+        outColors[i] = colors[i];
+    }
+
+    if (features != nullptr)
+    {
+        features->resize(cameraRays.size());
+        for (int i = 0; i < cameraRays.size(); i++)
+        {
+            scene.GetSurfaceFeatures(hits[i], points[i], (*features)[i]);
+        }
+    }
+}
+
+int WavefrontIntegrator::AddRay(Ray& ray, int depth)
+{
+    rays.push_back(ray);
+    hits.push_back(RayHit());
+    dists.push_back(-1);
+    depths.push_back(depth);
+    states.push_back(RAY_DONE);
+    points.push_back(ShadingPoint());
+    fresnel.push_back(0);
+    reflChildren.push_back(-1);
+    refrChildren.push_back(-1);
+    reflScales.push_back(1);
+    refrScales.push_back(1);
+    colors.push_back(Vector3::zero);
+    return rays.size() - 1;
+}
+
+// camera rays are already coherent, but reflections and refractions scatter. sorting them by the octant
+// of their direction and then a morton code of their origin puts rays that go through the same parts of
+// the bvh next to each other
+void WavefrontIntegrator::ReorderStage(int start, int end)
+{
+    traceOrder.resize(end - start);
+    if (!reorder || start == 0)
+    {
+        for (int i = start; i < end; i++)
+        {
+            traceOrder[i - start] = i;
+        }
+        return;
+    }
+
+    Vector3 originMin = rays[start].origin;
+    Vector3 originMax = originMin;
+    for (int i = start; i < end; i++)
+    {
+        originMin = Vector3::Min(originMin, rays[i].origin);
+        originMax = Vector3::Max(originMax, rays[i].origin);
+    }
+    Vector3 extent = originMax - originMin;
+    Float scale = 1023 / max(max(extent.x, extent.y), max(extent.z, (Float) 1e-6));
+
+    rayKeys.resize(end - start);
+    for (int i = start; i < end; i++)
+    {
+        Vector3 local = (rays[i].origin - originMin) * scale;
+        Vector3& dir = rays[i].direction;
+        uint64_t octant = (dir.x < 0 ? 1 : 0) | (dir.y < 0 ? 2 : 0) | (dir.z < 0 ? 4 : 0);
+        uint64_t morton = SpreadBits((uint64_t) local.x) | (SpreadBits((uint64_t) local.y) << 1) | (SpreadBits((uint64_t) local.z) << 2);
+        rayKeys[i - start] = make_pair((octant << 30) | morton, i);
+    }
+    sort(rayKeys.begin(), rayKeys.end());
+
+    for (int i = 0; i < rayKeys.size(); i++)
+    {
+        traceOrder[i] = rayKeys[i].second;
+    }
+}
+
+void WavefrontIntegrator::IntersectStage(int start, int end)
+{
+    int count = end - start;
+    if (packetSize > 1)
+    {
+        // neighbouring rays in the trace order take similar paths, so trace them in packets
+        RayPacket packet;
+        for (int j = 0; j < count; j += packetSize)
+        {
+            int packetCount = min(packetSize, count - j);
+            packet.Clear();
+            for (int k = 0; k < packetCount; k++)
+            {
+                packet.AddRay(&rays[traceOrder[j + k]]);
+            }
+            packet.Finish();
+            scene.IntersectPacket(packet);
+            for (int k = 0; k < packetCount; k++)
+            {
+                int i = traceOrder[j + k];
+                hits[i] = packet.hits[k];
+                dists[i] = hits[i] ? hits[i].t : -1;
+            }
+        }
+        return;
+    }
+
+    vector<int> ignoreList;
+    for (int j = 0; j < count; j++)
+    {
+        int i = traceOrder[j];
+        scene.Intersect(rays[i], hits[i], ignoreList);
+        dists[i] = hits[i] ? hits[i].t : -1;
+    }
+}
+
+// groups the hits by material so each material's parameters and code stay hot while it's shaded. hits
+// on a textured material are then ordered along a morton curve over their texture coordinates, so
+// neighbouring hits read the same texture tiles. misses go first, and the sort is stable so hits that
+// tie stay in ray order
+void WavefrontIntegrator::SortStage(int start, int end)
+{
+    order.resize(end - start);
+    shadeKeys.resize(end - start);
+    for (int i = start; i < end; i++)
+    {
+        order[i - start] = i;
+
+        if (!hits[i])
+        {
+            shadeKeys[i - start] = 0;
+            continue;
+        }
+
+        int mat = hits[i].materialIndex;
+        Material& material = scene.GetMaterial(mat);
+        uint64_t uvKey = 0;
+        if (material.GetTexture() >= 0 || material.GetBumpMap() >= 0 || material.GetSpecMap() >= 0)
+        {
+            // textures wrap, so only the fractional part picks the texel
+            Float u = hits[i].uv.u - floor(hits[i].uv.u);
+            Float v = hits[i].uv.v - floor(hits[i].uv.v);
+            uvKey = SpreadBits2D((uint64_t) (u * 65535)) | (SpreadBits2D((uint64_t) (v * 65535)) << 1);
+        }
+        shadeKeys[i - start] = ((uint64_t) (mat + 1) << 32) | uvKey;
+    }
+
+    stable_sort(order.begin(), order.end(), [this, start](int a, int b)
+                {
+                    return shadeKeys[a - start] < shadeKeys[b - start];
+                });
+}
+
+void WavefrontIntegrator::ShadeStage()
+{
+    shadowQueue.clear();
+    for (int j = 0; j < order.size(); j++)
+    {
+        int i = order[j];
+        if (!hits[i])
+        {
+            colors[i] = scene.SampleHDRI(rays[i]);
+            states[i] = RAY_DONE;
+            continue;
+        }
+
+        // find the texture footprint of the hit for mipmapping
+        hits[i].ComputeDifferentials(rays[i]);
+
+        if (scene.GetUnlit())
+        {
+            colors[i] = scene.GetUnlitColor(hits[i]);
+            states[i] = RAY_DONE;
+            continue;
+        }
+
+        // queue up a shadow ray for every light that's bright enough to matter
+        scene.SetupShadingPoint(rays[i], hits[i], points[i]);
+        scene.PickLights(hits[i], picks);
+        for (int k = 0; k < picks.size(); k++)
+        {
+            ShadowQuery query;
+            query.ray = i;
+            query.light = picks[k].first;
+            if (scene.GetLightContribution(query.light, points[i], rays[i], hits[i], picks[k].second, query.diffuse, query.specular))
+            {
+                shadowQueue.push_back(query);
+            }
+        }
+
+        if (depths[i] <= 0)
+        {
+            states[i] = RAY_LEAF;
+            continue;
+        }
+
+        // and the reflection and refraction rays for the next bounce
+        Ray reflRay, refrRay;
+        bool refraction;
+        fresnel[i] = scene.GetFresnelRays(rays[i], hits[i], points[i], reflRay, refrRay, refraction);
+        states[i] = RAY_FRESNEL;
+        reflChildren[i] = RAY_CUT;
+        if (scene.SurviveRoulette(reflRay, reflScales[i]))
+        {
+            int reflChild = AddRay(reflRay, depths[i] - 1);
+            reflChildren[i] = reflChild;
+            CountRender(COUNT_REFLECTION_RAYS);
+        }
+        if (refraction)
+        {
+            refrChildren[i] = RAY_CUT;
+            if (scene.SurviveRoulette(refrRay, refrScales[i]))
+            {
+                int refrChild = AddRay(refrRay, depths[i] - 1);
+                refrChildren[i] = refrChild;
+                CountRender(COUNT_REFRACTION_RAYS);
+            }
+        }
+    }
+}
+
+void WavefrontIntegrator::ShadowStage()
+{
+    shadows.resize(shadowQueue.size());
+    if (packetSize > 1)
+    {
+        // group the queue by light and trace each group's shadow rays in packets
+        shadowOrder.resize(shadowQueue.size());
+        for (int j = 0; j < shadowQueue.size(); j++)
+        {
+            shadowOrder[j] = j;
+        }
+        stable_sort(shadowOrder.begin(), shadowOrder.end(), [this](int a, int b)
+                    {
+                        return shadowQueue[a].light < shadowQueue[b].light;
+                    });
+
+        RayHit* packetHits[RayPacket::MAX_SIZE];
+        Vector3 packetShadows[RayPacket::MAX_SIZE];
+        for (int j = 0; j < shadowOrder.size();)
+        {
+            int light = shadowQueue[shadowOrder[j]].light;
+            int count = 0;
+            while (j + count < shadowOrder.size() && count < packetSize && shadowQueue[shadowOrder[j + count]].light == light)
+            {
+                packetHits[count] = &hits[shadowQueue[shadowOrder[j + count]].ray];
+                count++;
+            }
+
+            scene.GetShadowPacket(light, packetHits, count, packetShadows);
+            for (int k = 0; k < count; k++)
+            {
+                shadows[shadowOrder[j + k]] = packetShadows[k];
+            }
+            j += count;
+        }
+    }
+    else
+    {
+        for (int j = 0; j < shadowQueue.size(); j++)
+        {
+            shadows[j] = scene.GetShadow(shadowQueue[j].light, hits[shadowQueue[j].ray]);
+        }
+    }
+
+    // add the light in queue order, which is the order ShadeRay adds it in
+    for (int j = 0; j < shadowQueue.size(); j++)
+    {
+        ShadowQuery& query = shadowQueue[j];
+        scene.AddShadowedLight(points[query.ray], shadows[j], query.diffuse, query.specular);
+    }
+}
+
+// after the shadows so the light gets added up in the same order as ShadeRay
+void WavefrontIntegrator::EnvironmentStage()
+{
+    for (int j = 0; j < order.size(); j++)
+    {
+        int i = order[j];
+        if (states[i] != RAY_DONE)
+        {
+            scene.AddEnvironmentLight(points[i], rays[i], hits[i]);
+        }
+    }
+}
+
+// children come after their parents, so going backwards means they're always finished first
+void WavefrontIntegrator::CombineStage()
+{
+    for (int i = rays.size() - 1; i >= 0; i--)
+    {
+        ShadingPoint& sp = points[i];
+        if (states[i] == RAY_LEAF)
+        {
+            colors[i] = sp.ambient + sp.diffuse + sp.specular;
+        }
+        else if (states[i] == RAY_FRESNEL)
+        {
+            Vector3 reflColor = Vector3::zero;
+            if (reflChildren[i] >= 0)
+            {
+                reflColor = colors[reflChildren[i]] * reflScales[i];
+            }
+
+            Vector3 fresnelColor = reflColor;
+            int refrChild = refrChildren[i];
+            if (refrChild >= 0)
+            {
+                fresnelColor = scene.CombineFresnel(hits[i], fresnel[i], reflColor, colors[refrChild], dists[refrChild], sp.diffuse, refrScales[i]);
+            }
+            else if (refrChild == RAY_CUT)
+            {
+                fresnelColor = scene.CombineFresnel(hits[i], fresnel[i], reflColor, Vector3::zero, -1, sp.diffuse, 0);
+            }
+            colors[i] = scene.FinishShading(sp, fresnelColor, hits[i]);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef WAVEFRONTINTEGRATOR_H
+#define WAVEFRONTINTEGRATOR_H
+
+#include "math/Vector3.h"
+#include "Ray.h"
+#include "Scene.h"
+
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+// Traces a batch of rays breadth first, rather than following each ray's reflections and refractions
+// depth first like Scene::TraceRay. Each bounce runs as a few stages over every ray in the batch:
+// intersect them all, sort the hits by material and texture, shade them (queueing up their shadow rays and the next
+// bounce's rays), trace the queued shadow rays, then add the environment light. That keeps each stage's
+// code and data hot while it runs. Once the last bounce is done the colors get combined back up the
+// ray tree the same way ShadeRay does, so the image matches the depth first render.
+class WavefrontIntegrator
+{
+    public:
+        // packetSize is how many rays to trace through the bvh together, 0 traces them one at a time. reorder
+        // sorts each bounce's reflection and refraction rays by direction and origin before tracing them
+        WavefrontIntegrator(Scene& scene, int packetSize = 0, bool reorder = false);
+
+        // colors gets the color of each ray, depth is the number of bounces. features gets each ray's first
+        // hit for the denoiser, if it's given
+        void Trace(vector<Ray>& cameraRays, int depth, vector<Vector3>& colors, vector<SurfaceFeatures>* features = nullptr);
+
+    private:
+        enum RayState
+        {
+            RAY_DONE,       // missed or unlit, the color is final
+            RAY_LEAF,       // out of bounces, the color is just the direct light
+            RAY_FRESNEL     // waiting on its reflection and refraction rays
+        };
+
+        static const int RAY_CUT = -2;  // child index for a ray russian roulette decided not to trace
+
+        struct ShadowQuery
+        {
+            int ray;
+            int light;
+            Vector3 diffuse, specular;  // unshadowed light, scaled by the shadow once it's traced
+        };
+
+        Scene& scene;
+        int packetSize;
+        bool reorder;
+
+        // one entry per ray in the tree, each field in its own array. rays are added a bounce at a time, so
+        // children always come after their parents
+        vector<Ray> rays;
+        vector<RayHit> hits;
+        vector<Float> dists;
+        vector<int> depths;
+        vector<char> states;
+        vector<ShadingPoint> points;
+        vector<Float> fresnel;
+        vector<int> reflChildren;   // RAY_CUT if it wasn't traced
+        vector<int> refrChildren;   // -1 for total internal reflection, RAY_CUT if it wasn't traced
+        vector<Float> reflScales;   // from russian roulette, what to scale the children's colors by
+        vector<Float> refrScales;
+        vector<Vector3> colors;
+
+        vector<int> order;          // the current bounce's rays sorted by material and texture coordinates
+        vector<uint64_t> shadeKeys;
+        vector<int> traceOrder;     // the order to intersect them in
+        vector<pair<uint64_t, int>> rayKeys;
+        vector<ShadowQuery> shadowQueue;
+        vector<int> shadowOrder;    // the queue sorted by light, so packets can go to the same light
+        vector<Vector3> shadows;
+        vector<pair<int, Float>> picks;
+
+        int AddRay(Ray& ray, int depth);
+        void ReorderStage(int start, int end);
+        void IntersectStage(int start, int end);
+        void SortStage(int start, int end);
+        void ShadeStage();
+        void ShadowStage();
+        void EnvironmentStage();
+        void CombineStage();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "AreaLight.h"
+
+// any two unit vectors perpendicular to n and each other
+static void MakeBasis(Vector3 n, Vector3& t, Vector3& b)
+{
+    Vector3 axis = fabs(n.x) < 0.9 ? Vector3(1, 0, 0) : Vector3(0, 0, 1);
+    t = Vector3::ProjectOnPlane(axis, n).normalized();
+    b = n.cross(t);
+}
+
+AreaLight::AreaLight(AreaShape shape, Vector3 position, Vector3 normal, Float width, Float height, Vector3 color,
+                     Float c1, Float c2, Float c3) : PointLight(position, color, c1, c2, c3)
+{
+    this->shape = shape;
+    this->normal = normal.normalized();
+    this->width = width;
+    this->height = height;
+
+    // the width runs along x, unless the light faces along x
+    MakeBasis(this->normal, tangent, bitangent);
+}
+
+Float AreaLight::GetIntensityAt(Vector3 point)
+{
+    Float inten = PointLight::GetIntensityAt(point);
+    if (shape == AREA_SPHERE)
+    {
+        return inten;
+    }
+
+    Float cosTheta = normal.dot((point - position).normalized());
+    return cosTheta > 0 ? inten * cosTheta : 0;
+}
+
+bool AreaLight::GetBounds(LightBounds& bounds)
+{
+    PointLight::GetBounds(bounds);
+    if (shape != AREA_SPHERE)
+    {
+        // one sided, so it only shines into the hemisphere around the normal
+        bounds.axis = normal;
+        bounds.cosSpread = 0;
+    }
+    return true;
+}
+
+bool AreaLight::Influences(Vector3 point)
+{
+    if (!PointLight::Influences(point))
+    {
+        return false;
+    }
+    return shape == AREA_SPHERE || normal.dot(point - position) >= -1e-4;
+}
+
+Vector3 AreaLight::SampleShadowRay(Vector3 point, Float u, Float v, Float& dist)
+{
+    Vector3 target;
+    if (shape == AREA_DISK)
+    {
+        // concentric mapping keeps the strata about the same shape once they're on the disk
+        Float a = 2 * u - 1;
+        Float b = 2 * v - 1;
+        Float r = 0, phi = 0;
+        if (a != 0 || b != 0)
+        {
+            if (fabs(a) > fabs(b))
+            {
+                r = a;
+                phi = M_PI / 4 * (b / a);
+            }
+            else
+            {
+                r = b;
+                phi = M_PI / 2 - M_PI / 4 * (a / b);
+            }
+        }
+        r *= width * 0.5;
+        target = position + tangent * (r * cos(phi)) + bitangent * (r * sin(phi));
+    }
+    else if (shape == AREA_RECT)
+    {
+        target = position + tangent * ((u - 0.5) * width) + bitangent * ((v - 0.5) * height);
+    }
+    else
+    {
+        // uniformly over the hemisphere facing the point, which is the only part it can see
+        Vector3 w = (point - position).normalized();
+        Vector3 t, b;
+        MakeBasis(w, t, b);
+        Float z = u;
+        Float r = sqrt(fmax(0, 1 - z * z));
+        Float phi = 2 * M_PI * v;
+        target = position + (w * z + t * (r * cos(phi)) + b * (r * sin(phi))) * (width * 0.5);
+    }
+
+    Vector3 toTarget = target - point;
+    dist = toTarget.magnitude();
+    return toTarget / dist;
+}
\ No newline at end of file
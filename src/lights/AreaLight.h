@@ -0,0 +1,37 @@
+#ifndef AREALIGHT_H
+#define AREALIGHT_H
+
+#include "PointLight.h"
+
+enum AreaShape
+{
+    AREA_DISK,
+    AREA_RECT,
+    AREA_SPHERE
+};
+
+// A point light with a shape, so soft shadows aim their rays at spots spread over the light's surface
+// rather than jittering around its center. Shading still uses the center of the light, with disks and
+// rectangles only lighting the side their normal faces (falling off with the cosine like a diffuse
+// emitter), and spheres lighting every direction.
+class AreaLight : public PointLight
+{
+    public:
+        AreaShape shape;
+        Vector3 normal;
+        Float width, height;    // the diameter for disks and spheres, which ignore the height
+
+        AreaLight(AreaShape shape, Vector3 position, Vector3 normal, Float width, Float height, Vector3 color,
+                  Float c1 = 1.0, Float c2 = 0.0, Float c3 = 0.0);
+        ~AreaLight() {};
+
+        Float GetIntensityAt(Vector3 point);
+        bool GetBounds(LightBounds& bounds);
+        bool Influences(Vector3 point);
+        Vector3 SampleShadowRay(Vector3 point, Float u, Float v, Float& dist);
+
+    private:
+        Vector3 tangent, bitangent; // width runs along the tangent and height along the bitangent
+};
+
+#endif
\ No newline at end of file
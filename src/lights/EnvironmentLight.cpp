@@ -0,0 +1,61 @@
+#include "EnvironmentLight.h"
+
+EnvironmentLight::EnvironmentLight(shared_ptr<Image> hdri, shared_ptr<EnvironmentMap> environment, Float strength, int numSamples)
+{
+    this->environment = environment;
+    this->strength = strength;
+    this->numSamples = numSamples;
+
+    // build the distribution at a lower resolution, using the mip filtered hdri
+    int width = min(hdri->GetWidth(), 512);
+    int height = max(1, width * hdri->GetHeight() / hdri->GetWidth());
+    Float footprint = 1.0 / width;
+
+    vector<Float> luminance(width * height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            Vector3 col = hdri->GetColorUV((x + 0.5) / width, (y + 0.5) / height, footprint);
+            luminance[y * width + x] = 0.2126 * col.x + 0.7152 * col.y + 0.0722 * col.z;
+        }
+    }
+
+    // the radiance comes from the filtered environment map which spreads bright spots out a little, so take
+    // the max over each texel's neighbours to make sure those edges don't get a tiny pdf and turn into fireflies
+    vector<Float> values(width * height);
+    for (int y = 0; y < height; y++)
+    {
+        Float sinTheta = sin((y + 0.5) / height * M_PI);
+        for (int x = 0; x < width; x++)
+        {
+            Float maxLum = 0;
+            for (int dy = max(y - 1, 0); dy <= min(y + 1, height - 1); dy++)
+            {
+                for (int dx = x - 1; dx <= x + 1; dx++)
+                {
+                    maxLum = max(maxLum, luminance[dy * width + (dx + width) % width]);
+                }
+            }
+            values[y * width + x] = maxLum * sinTheta;
+        }
+    }
+
+    distribution = Distribution2D(values.data(), width, height);
+}
+
+Vector3 EnvironmentLight::Sample(Float u1, Float u2, Vector3& dir, Float& pdf)
+{
+    Float u, v, uvPdf;
+    distribution.Sample(u1, u2, u, v, uvPdf);
+
+    // same mapping as SampleHDRI used, u = phi / 2pi + 0.5 and v = theta / pi
+    Float theta = v * M_PI;
+    Float phi = (u - 0.5) * 2 * M_PI;
+    Float sinTheta = sin(theta);
+    dir = Vector3(sinTheta * cos(phi), cos(theta), sinTheta * sin(phi));
+
+    // convert from a pdf over uv to one over solid angle
+    pdf = sinTheta > 0 ? uvPdf / (2 * M_PI * M_PI * sinTheta) : 0;
+    return environment->Sample(dir, 0) * strength;
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef ENVIRONMENTLIGHT_H
+#define ENVIRONMENTLIGHT_H
+
+#include "math/Vector3.h"
+#include "math/Distribution.h"
+#include "core/Image.h"
+#include "core/EnvironmentMap.h"
+
+#include <memory>
+
+// Lights the scene with the hdri. Rather than sampling directions uniformly, directions are picked in
+// proportion to the hdri's luminance (times sin(theta) to account for the lat-long mapping squashing
+// texels near the poles), so most shadow rays go toward the bright parts of the environment.
+class EnvironmentLight
+{
+    public:
+        Float strength;
+        int numSamples;
+
+        EnvironmentLight(shared_ptr<Image> hdri, shared_ptr<EnvironmentMap> environment, Float strength, int numSamples);
+
+        // picks a direction for the uniform random numbers u1 and u2, returns the radiance from it
+        // and the pdf of having picked it (per unit solid angle)
+        Vector3 Sample(Float u1, Float u2, Vector3& dir, Float& pdf);
+
+    private:
+        shared_ptr<EnvironmentMap> environment;
+        Distribution2D distribution;
+};
+
+#endif
\ No newline at end of file
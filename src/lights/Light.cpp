@@ -1,4 +1,7 @@
 #include "Light.h"
+#include "math/Random.h"
+
+#include <stdlib.h>
 
 Light::Light()
 {
@@ -8,4 +11,42 @@ Light::Light()
 Light::Light(Vector3 color)
 {
     this->color = color;
+}
+
+// solves c1 + c2 * d + c3 * d^2 = |color| / LIGHT_CUTOFF for the distance d where the attenuated light
+// drops below the cutoff, which is infinite if it never attenuates
+Float Light::GetCutoffRadius(Vector3 color, Float c1, Float c2, Float c3)
+{
+    Float target = color.magnitude() / LIGHT_CUTOFF;
+    if (c1 >= target)
+    {
+        return 0;
+    }
+    if (c3 > 0)
+    {
+        Float disc = c2 * c2 + 4 * c3 * (target - c1);
+        return (-c2 + sqrt(disc)) / (2 * c3);
+    }
+    if (c2 > 0)
+    {
+        return (target - c1) / c2;
+    }
+    return INFINITY;
+}
+
+Vector3 Light::SampleShadowRay(Vector3 point, Float u, Float v, Float& dist)
+{
+    Vector3 toLight = -GetDirectionAt(point);
+    dist = GetDistanceFrom(point);
+
+    // directional lights are infinitely far away, so an offset wouldn't change anything
+    if (!(dist < INFINITY))
+    {
+        return toLight;
+    }
+
+    Vector3 offset = Vector3(u - 0.5, RandomFloat() - 0.5, v - 0.5);
+    Vector3 target = toLight * dist + 2.0 * offset;
+    dist = target.magnitude();
+    return target / dist;
 }
\ No newline at end of file
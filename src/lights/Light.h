@@ -5,6 +5,21 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+// lights dimmer than this (the magnitude of their color times intensity) don't get shaded
+const Float LIGHT_CUTOFF = 0.01;
+
+// what the light bvh needs to know about a light: where it is, the cone of directions it shines in,
+// how bright it is and its attenuation coefficients
+struct LightBounds
+{
+    Vector3 position;
+    Vector3 axis;
+    Float cosSpread;    // cos of the cone's half angle, -1 for lights that shine in every direction
+    Float power;
+    Float c1, c2, c3;
+    Float radius;       // distance past which the light is dimmer than LIGHT_CUTOFF
+};
+
 class Light
 {
     public:
@@ -17,6 +32,19 @@ class Light
         virtual Float GetIntensityAt(Vector3 point) = 0;
         virtual Vector3 GetDirectionAt(Vector3 point) = 0;
         virtual Float GetDistanceFrom(Vector3 point) = 0;
+
+        // returns false for lights that can't be bounded (like directional lights), those always get shaded
+        virtual bool GetBounds(LightBounds& bounds) { return false; }
+        Float GetPower() { return 0.2126 * color.x + 0.7152 * color.y + 0.0722 * color.z; }
+
+        // conservative test for whether the light could be brighter than LIGHT_CUTOFF at the point
+        virtual bool Influences(Vector3 point) { return true; }
+        static Float GetCutoffRadius(Vector3 color, Float c1, Float c2, Float c3);
+
+        // direction and distance of a soft shadow ray from the point to a spot on the light picked with the
+        // stratified random numbers u and v in [0, 1). lights without an area jitter the spot inside a 2 unit
+        // cube around the light
+        virtual Vector3 SampleShadowRay(Vector3 point, Float u, Float v, Float& dist);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include "LightBVH.h"
+
+#include <algorithm>
+
+// smallest cone holding both cones, following pbrt's DirectionCone::Union
+static void UnionCones(Vector3 axisA, Float cosA, Vector3 axisB, Float cosB, Vector3& axis, Float& cosSpread)
+{
+    if (cosA <= -1 || cosB <= -1)
+    {
+        axis = axisA;
+        cosSpread = -1;
+        return;
+    }
+
+    Float thetaA = acos(max((Float) -1, min((Float) 1, cosA)));
+    Float thetaB = acos(max((Float) -1, min((Float) 1, cosB)));
+    Float thetaD = Vector3::Angle(axisA, axisB);
+
+    // one cone already holds the other
+    if (min(thetaD + thetaB, (Float) M_PI) <= thetaA)
+    {
+        axis = axisA;
+        cosSpread = cosA;
+        return;
+    }
+    if (min(thetaD + thetaA, (Float) M_PI) <= thetaB)
+    {
+        axis = axisB;
+        cosSpread = cosB;
+        return;
+    }
+
+    Float thetaO = (thetaA + thetaD + thetaB) / 2;
+    Vector3 rotAxis = axisA.cross(axisB);
+    if (thetaO >= M_PI || rotAxis.sqrMagnitude() < 1e-12)
+    {
+        axis = axisA;
+        cosSpread = -1;
+        return;
+    }
+
+    // rotate axis a towards b so the new cone just touches both of them
+    Float thetaR = thetaO - thetaA;
+    rotAxis.Normalize();
+    axis = axisA * cos(thetaR) + rotAxis.cross(axisA) * sin(thetaR) + rotAxis * rotAxis.dot(axisA) * (1 - cos(thetaR));
+    axis.Normalize();
+    cosSpread = cos(thetaO);
+}
+
+LightBVH::LightBVH(vector<shared_ptr<Light>>& lights)
+{
+    vector<pair<int, LightBounds>> bounded;
+    for (int i = 0; i < lights.size(); i++)
+    {
+        LightBounds bounds;
+        if (lights[i]->GetBounds(bounds))
+        {
+            bounded.push_back(make_pair(i, bounds));
+        }
+        else
+        {
+            unboundedLights.push_back(i);
+        }
+    }
+
+    numLights = bounded.size();
+    if (numLights > 0)
+    {
+        nodes.reserve(2 * numLights - 1);
+        Build(bounded, 0, numLights);
+    }
+}
+
+// builds the subtree for lights [start, end) and returns the index of its root node
+int LightBVH::Build(vector<pair<int, LightBounds>>& lights, int start, int end)
+{
+    Node node;
+    LightBounds& first = lights[start].second;
+    node.min = first.position;
+    node.max = first.position;
+    node.axis = first.axis;
+    node.cosSpread = first.cosSpread;
+    node.power = 0;
+    node.c1 = first.c1;
+    node.c2 = first.c2;
+    node.c3 = first.c3;
+    node.radius = first.radius;
+    node.children[0] = node.children[1] = -1;
+    node.lightIndex = lights[start].first;
+
+    for (int i = start; i < end; i++)
+    {
+        LightBounds& bounds = lights[i].second;
+        node.min = Vector3::Min(node.min, bounds.position);
+        node.max = Vector3::Max(node.max, bounds.position);
+        node.power += bounds.power;
+        node.c1 = min(node.c1, bounds.c1);
+        node.c2 = min(node.c2, bounds.c2);
+        node.c3 = min(node.c3, bounds.c3);
+        node.radius = max(node.radius, bounds.radius);
+        if (i > start)
+        {
+            UnionCones(node.axis, node.cosSpread, bounds.axis, bounds.cosSpread, node.axis, node.cosSpread);
+        }
+    }
+
+    int index = nodes.size();
+    nodes.push_back(node);
+    if (end - start == 1)
+    {
+        return index;
+    }
+
+    // split at the median along the longest axis
+    Vector3 extent = node.max - node.min;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    int mid = (start + end) / 2;
+    nth_element(lights.begin() + start, lights.begin() + mid, lights.begin() + end,
+                [axis](const pair<int, LightBounds>& a, const pair<int, LightBounds>& b)
+                {
+                    const Vector3& pa = a.second.position;
+                    const Vector3& pb = b.second.position;
+                    return axis == 0 ? pa.x < pb.x : (axis == 1 ? pa.y < pb.y : pa.z < pb.z);
+                });
+
+    int left = Build(lights, start, mid);
+    int right = Build(lights, mid, end);
+    nodes[index].children[0] = left;
+    nodes[index].children[1] = right;
+    return index;
+}
+
+// upper bound on how much the node's lights could light the point
+Float LightBVH::Importance(const Node& node, Vector3 point)
+{
+    Vector3 nodeMin = node.min;
+    Vector3 nodeMax = node.max;
+
+    // the closest point of the box gives the smallest attenuation any of its lights could have
+    Vector3 closest = Vector3::Max(nodeMin, Vector3::Min(point, nodeMax));
+    Float dist = (point - closest).magnitude();
+    if (dist > node.radius)
+    {
+        return 0;
+    }
+
+    Float atten = max(node.c1 + node.c2 * dist + node.c3 * dist * dist, (Float) 1e-4);
+    Float importance = node.power / atten;
+
+    if (node.cosSpread <= -1)
+    {
+        return importance;
+    }
+
+    // otherwise check the point is inside the cone once it's widened by the angle the box takes up
+    Vector3 center = (nodeMin + nodeMax) * 0.5;
+    Float radius = (nodeMax - nodeMin).magnitude() * 0.5;
+    Vector3 toPoint = point - center;
+    Float d = toPoint.magnitude();
+    if (d <= radius)
+    {
+        return importance;
+    }
+
+    Vector3 axis = node.axis;
+    Float cosW = axis.dot(toPoint) / d;
+    Float sinW = sqrt(max((Float) 0, 1 - cosW * cosW));
+    Float cosO = node.cosSpread;
+    Float sinO = sqrt(max((Float) 0, 1 - cosO * cosO));
+
+    // angle outside of the cone, max(0, theta_w - theta_o)
+    Float cosX = cosW < cosO ? cosW * cosO + sinW * sinO : 1;
+
+    // the lights can reach the point if that angle is less than the one the box subtends
+    Float sinB = radius / d;
+    Float cosB = sqrt(max((Float) 0, 1 - sinB * sinB));
+    if (cosX < cosB - 1e-4)
+    {
+        return 0;
+    }
+
+    return importance;
+}
+
+int LightBVH::Sample(Vector3 point, Float u, Float& pmf)
+{
+    pmf = 1;
+    if (nodes.size() == 0 || Importance(nodes[0], point) <= 0)
+    {
+        return -1;
+    }
+
+    int current = 0;
+    while (nodes[current].children[0] != -1)
+    {
+        const Node& node = nodes[current];
+        Float left = Importance(nodes[node.children[0]], point);
+        Float right = Importance(nodes[node.children[1]], point);
+        if (left <= 0 && right <= 0)
+        {
+            return -1;
+        }
+
+        // pick a child and rescale u so it can be reused further down
+        Float pLeft = left / (left + right);
+        if (u < pLeft)
+        {
+            u = min(u / pLeft, (Float) 0.99999994);
+            pmf *= pLeft;
+            current = node.children[0];
+        }
+        else
+        {
+            u = min((u - pLeft) / (1 - pLeft), (Float) 0.99999994);
+            pmf *= 1 - pLeft;
+            current = node.children[1];
+        }
+    }
+
+    return nodes[current].lightIndex;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef LIGHTBVH_H
+#define LIGHTBVH_H
+
+#include "Light.h"
+
+#include <vector>
+#include <memory>
+
+using namespace std;
+
+// Bounding volume hierarchy over the point and spot lights, for scenes with too many lights to shade
+// every one at each hit. Each node holds the bounding box of its lights, a cone bounding the directions
+// they shine in, their total power and their smallest attenuation coefficients, which together give an
+// upper bound on how much the node can light a point. Sampling walks down from the root picking
+// children in proportion to that bound, so it takes O(log n) steps to pick a light.
+class LightBVH
+{
+    public:
+        LightBVH(vector<shared_ptr<Light>>& lights);
+
+        // picks a light for the point using the uniform random number u, returns its index into the
+        // lights it was built with (or -1 if none can reach the point) and the probability of picking it
+        int Sample(Vector3 point, Float u, Float& pmf);
+
+        int GetNumLights() { return numLights; }
+        const vector<int>& GetUnboundedLights() { return unboundedLights; }
+
+    private:
+        struct Node
+        {
+            Vector3 min, max;
+            Vector3 axis;
+            Float cosSpread;
+            Float power;
+            Float c1, c2, c3;
+            Float radius;       // largest influence radius of its lights
+            int children[2];    // -1 for leaves
+            int lightIndex;     // only set for leaves
+        };
+
+        vector<Node> nodes;
+        vector<int> unboundedLights;    // directional lights, these don't go in the tree
+        int numLights;
+
+        int Build(vector<pair<int, LightBounds>>& lights, int start, int end);
+        Float Importance(const Node& node, Vector3 point);
+};
+
+#endif
\ No newline at end of file
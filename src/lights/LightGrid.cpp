@@ -0,0 +1,109 @@
+#include "LightGrid.h"
+
+#include <algorithm>
+
+LightGrid::LightGrid(vector<shared_ptr<Light>>& lights)
+{
+    // find the lights with a finite influence volume
+    vector<pair<int, LightBounds>> bounded;
+    for (int i = 0; i < lights.size(); i++)
+    {
+        LightBounds bounds;
+        if (lights[i]->GetBounds(bounds) && bounds.radius < INFINITY)
+        {
+            if (bounds.radius > 0) // lights with a radius of 0 can't light anything
+            {
+                bounded.push_back(make_pair(i, bounds));
+            }
+        }
+        else
+        {
+            unboundedLights.push_back(i);
+        }
+    }
+    numCulledLights = bounded.size();
+
+    if (bounded.size() == 0)
+    {
+        resolution[0] = resolution[1] = resolution[2] = 0;
+        return;
+    }
+
+    // grid covers all of the influence spheres
+    Float totalRadius = 0;
+    min = Vector3(INFINITY, INFINITY, INFINITY);
+    max = -min;
+    for (int i = 0; i < bounded.size(); i++)
+    {
+        Vector3 r = Vector3(1, 1, 1) * bounded[i].second.radius;
+        min = Vector3::Min(min, bounded[i].second.position - r);
+        max = Vector3::Max(max, bounded[i].second.position + r);
+        totalRadius += bounded[i].second.radius;
+    }
+
+    // aim for cells about the size of the average influence radius
+    Float targetSize = totalRadius / bounded.size();
+    Vector3 extent = max - min;
+    Float extents[3] = { extent.x, extent.y, extent.z };
+    Float sizes[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        resolution[axis] = std::max(1, std::min((int) MAX_RESOLUTION, (int) ceil(extents[axis] / targetSize)));
+        sizes[axis] = extents[axis] / resolution[axis];
+    }
+    cellSize = Vector3(sizes[0], sizes[1], sizes[2]);
+    cells.resize(resolution[0] * resolution[1] * resolution[2]);
+
+    // add every light to the cells its sphere's box overlaps, merging in the unbounded lights so the
+    // cell lists stay in the scene's light order
+    vector<vector<int>> cellLights(cells.size());
+    for (int i = 0; i < bounded.size(); i++)
+    {
+        Vector3 pos = bounded[i].second.position;
+        Float radius = bounded[i].second.radius;
+        Float lo[3] = { pos.x - radius - min.x, pos.y - radius - min.y, pos.z - radius - min.z };
+        Float hi[3] = { pos.x + radius - min.x, pos.y + radius - min.y, pos.z + radius - min.z };
+        int cellMin[3], cellMax[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            cellMin[axis] = std::max(0, std::min(resolution[axis] - 1, (int) floor(lo[axis] / sizes[axis])));
+            cellMax[axis] = std::max(0, std::min(resolution[axis] - 1, (int) floor(hi[axis] / sizes[axis])));
+        }
+
+        for (int z = cellMin[2]; z <= cellMax[2]; z++)
+        {
+            for (int y = cellMin[1]; y <= cellMax[1]; y++)
+            {
+                for (int x = cellMin[0]; x <= cellMax[0]; x++)
+                {
+                    cellLights[(z * resolution[1] + y) * resolution[0] + x].push_back(bounded[i].first);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < cells.size(); i++)
+    {
+        cells[i].resize(cellLights[i].size() + unboundedLights.size());
+        merge(cellLights[i].begin(), cellLights[i].end(), unboundedLights.begin(), unboundedLights.end(), cells[i].begin());
+    }
+}
+
+const vector<int>& LightGrid::GetLights(Vector3 point)
+{
+    if (cells.size() == 0)
+    {
+        return unboundedLights;
+    }
+
+    Vector3 local = point - min;
+    int x = (int) floor(local.x / cellSize.x);
+    int y = (int) floor(local.y / cellSize.y);
+    int z = (int) floor(local.z / cellSize.z);
+    if (x < 0 || y < 0 || z < 0 || x >= resolution[0] || y >= resolution[1] || z >= resolution[2])
+    {
+        return unboundedLights;
+    }
+
+    return cells[(z * resolution[1] + y) * resolution[0] + x];
+}
\ No newline at end of file
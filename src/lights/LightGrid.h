@@ -0,0 +1,36 @@
+#ifndef LIGHTGRID_H
+#define LIGHTGRID_H
+
+#include "Light.h"
+
+#include <vector>
+#include <memory>
+
+using namespace std;
+
+// Uniform grid over the influence volumes of the lights (the sphere where an attenuated light is
+// brighter than LIGHT_CUTOFF), so a shading point only has to look at the lights listed in its cell
+// instead of every light in the scene. Lights that never drop below the cutoff (directional lights, or
+// point and spot lights without attenuation) are listed in every cell.
+class LightGrid
+{
+    public:
+        static const int MAX_RESOLUTION = 32;   // cells along each axis
+
+        LightGrid(vector<shared_ptr<Light>>& lights);
+
+        // lights that might reach the point, in the same order as the scene's lights
+        const vector<int>& GetLights(Vector3 point);
+
+        int GetNumCulledLights() { return numCulledLights; }
+
+    private:
+        Vector3 min, max;
+        Vector3 cellSize;
+        int resolution[3];
+        vector<vector<int>> cells;
+        vector<int> unboundedLights;    // used for points outside the grid
+        int numCulledLights;            // lights with a finite influence radius
+};
+
+#endif
\ No newline at end of file
@@ -42,4 +42,24 @@ Float PointLight::GetIntensityAt(Vector3 point)
 Float PointLight::GetDistanceFrom(Vector3 point)
 {
     return (position - point).magnitude();
+}
+
+bool PointLight::GetBounds(LightBounds& bounds)
+{
+    bounds.position = position;
+    bounds.axis = Vector3(0, 1, 0);
+    bounds.cosSpread = -1;
+    bounds.power = GetPower();
+    bounds.c1 = c1;
+    bounds.c2 = c2;
+    bounds.c3 = c3;
+    bounds.radius = GetCutoffRadius(color, c1, c2, c3);
+    return true;
+}
+
+bool PointLight::Influences(Vector3 point)
+{
+    // pad the radius a little so rounding can't cull a light that would have been shaded
+    Float radius = GetCutoffRadius(color, c1, c2, c3) * 1.001;
+    return (point - position).sqrMagnitude() <= radius * radius;
 }
\ No newline at end of file
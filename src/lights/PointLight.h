@@ -17,6 +17,8 @@ class PointLight : public Light
         Float GetIntensityAt(Vector3 point);
         Vector3 GetDirectionAt(Vector3 point);
         Float GetDistanceFrom(Vector3 point);
+        bool GetBounds(LightBounds& bounds);
+        bool Influences(Vector3 point);
 };
 
 #endif
\ No newline at end of file
@@ -101,4 +101,31 @@ Vector3 SpotLight::GetDirectionAt(Vector3 point)
 Float SpotLight::GetDistanceFrom(Vector3 point)
 {
     return (position - point).magnitude();
+}
+
+// nothing gets lit outside the outer cone
+bool SpotLight::GetBounds(LightBounds& bounds)
+{
+    bounds.position = position;
+    bounds.axis = direction;
+    bounds.cosSpread = outerAngleCos;
+    bounds.power = GetPower();
+    bounds.c1 = c1;
+    bounds.c2 = c2;
+    bounds.c3 = c3;
+    bounds.radius = GetCutoffRadius(color, c1, c2, c3);
+    return true;
+}
+
+// has to be in range and inside the outer cone
+bool SpotLight::Influences(Vector3 point)
+{
+    Float radius = GetCutoffRadius(color, c1, c2, c3) * 1.001;
+    Vector3 toPoint = point - position;
+    Float sqrDist = toPoint.sqrMagnitude();
+    if (sqrDist > radius * radius)
+    {
+        return false;
+    }
+    return toPoint.dot(direction) >= outerAngleCos * sqrt(sqrDist) - 1e-4;
 }
\ No newline at end of file
@@ -21,6 +21,8 @@ class SpotLight : public Light
         Float GetIntensityAt(Vector3 point);
         Vector3 GetDirectionAt(Vector3 point);
         Float GetDistanceFrom(Vector3 point);
+        bool GetBounds(LightBounds& bounds);
+        bool Influences(Vector3 point);
 
     private:
         Float innerAngleCos; // allows us to just use dot product instead of doing a full acos
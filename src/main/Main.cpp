@@ -10,45 +10,79 @@
 #include <chrono>
 
 #include "core/TxtReader.h"
+#include "core/RenderReport.h"
+#include "math/FastMath.h"
 
 using namespace std;
 
-void getOutputFilename(int argc, char* argv[], string& outputFilename);
+void getOutputFilename(vector<string>& args, string& outputFilename);
 
 int main(int argc, char* argv[])
 {
     Camera camera; // Camera handles ray generation and image creation
     Scene scene; // Scene handles the actual ray tracing and shape storage
     string outputFilename;
+    string reportFilename;
+    string traceFilename;
     auto start = chrono::high_resolution_clock::now();
 
     TxtReader txtReader;
 
+    // pull out the options, leaving the input and output filenames
+    vector<string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        if (string(argv[i]) == "--report" && i + 1 < argc)
+        {
+            reportFilename = argv[++i];
+        }
+        else if (string(argv[i]) == "--trace" && i + 1 < argc)
+        {
+            traceFilename = argv[++i];
+        }
+        else
+        {
+            args.push_back(argv[i]);
+        }
+    }
+
     // first check if user provided a filename as only argument
-    if (argc < 2 || argc > 3)
+    if (args.size() < 1 || args.size() > 2)
     {
-        cout << "Usage: " << argv[0] << " <input_filename> [output_filename]\n";
+        cout << "Usage: " << argv[0] << " <input_filename> [output_filename] [--report <report.json>] [--trace <trace.json>]\n";
+        cout << "       " << argv[0] << " --bench-math\n";
         return 1;
     }
 
+    if (args[0] == "--bench-math")
+    {
+        return RunMathBenchmark();
+    }
+
     // get output filename
-    getOutputFilename(argc, argv, outputFilename);
+    getOutputFilename(args, outputFilename);
 
-    // create default material
-    Material defaultMaterial;
-    defaultMaterial.SetDiffuse(Vector3(0.8, 0.8, 0.8));
-    defaultMaterial.SetSpecular(Vector3(1.0, 1.0, 1.0));
-    defaultMaterial.SetK_A(0.4);
-    defaultMaterial.SetK_D(0.8);
-    defaultMaterial.SetK_S(0.4);
-    defaultMaterial.SetSpecFalloff(64.0);
+    // has to be on before any threads start
+    if (!traceFilename.empty())
+    {
+        Trace::Enable();
+    }
 
-    scene.AddMaterial(defaultMaterial);
+    // create default material
+    scene.AddDefaultMaterial();
 
     // start by parsing the input file
-    if (txtReader.parseInput(argv[1], scene, camera) != 0)
     {
-        return 1;
+        ScopedPhaseTimer timer(PHASE_PARSE);
+        if (txtReader.parseInput(args[0], scene, camera) != 0)
+        {
+            return 1;
+        }
+    }
+
+    if (scene.GetTextureMemoryUsage() > 0)
+    {
+        cout << "Texture memory: " << scene.GetTextureMemoryUsage() / (1024.0 * 1024.0) << " MB" << endl;
     }
 
     // make sure the camera is set up correctly
@@ -61,47 +95,100 @@ int main(int argc, char* argv[])
     }
 
     // construct BVH
-    if (scene.GetUseBVH())
     {
-        cout << "Constructing BVH..." << endl;
-        scene.InitializeBVH();
+        ScopedPhaseTimer timer(PHASE_BVH);
+        if (scene.GetUseBVH())
+        {
+            cout << "Constructing BVH..." << endl;
+        }
+        scene.InitializeAccelerators();
     }
 
     // now that we have a valid scene, we can render it
     Image image;
     cout << "Rendering image..." << endl;
-    if (camera.RenderScene(scene, image) != 0)
     {
-        return 1;
+        ScopedPhaseTimer timer(PHASE_RENDER);
+        if (camera.RenderScene(scene, image) != 0)
+        {
+            return 1;
+        }
     }
 
+    if (scene.GetTextureCache() != nullptr)
+    {
+        scene.GetTextureCache()->PrintStats();
+    }
+    scene.PrintShadowCacheStats();
+
     // write the image to a file
     cout << "Writing image to file..." << endl;
+    ScopedPhaseTimer writeTimer(PHASE_WRITE);
     if (image.SaveToFilePPM(outputFilename) != 0)
     {
         return 1;
     }
+    if (camera.GetCheckpoint().IsEnabled())
+    {
+        // the image is safely written, so there's nothing left to resume
+        camera.GetCheckpoint().Remove();
+    }
+    if (!camera.GetHeatmapFile().empty())
+    {
+        camera.GetHeatmap().PrintSummary();
+        if (camera.GetHeatmap().SaveToFilePPM(camera.GetHeatmapFile()) != 0)
+        {
+            return 1;
+        }
+    }
+    if (!camera.GetAOVFile().empty())
+    {
+        cout << "Writing aovs to " << camera.GetAOVFile() << "..." << endl;
+        if (camera.GetFramebuffer().SaveToFileEXR(camera.GetAOVFile()) != 0)
+        {
+            return 1;
+        }
+    }
+    writeTimer.Stop();
+
+    // the report needs the bvh, so write it before cleaning up
+    auto end = chrono::high_resolution_clock::now();
+    double elapsed = chrono::duration_cast<chrono::milliseconds>(end - start).count() / (double)1000;
+    if (!reportFilename.empty())
+    {
+        cout << "Writing report to " << reportFilename << "..." << endl;
+        if (WriteRenderReport(reportFilename, args[0], outputFilename, scene, camera, elapsed) != 0)
+        {
+            return 1;
+        }
+    }
+    if (!traceFilename.empty())
+    {
+        cout << "Writing trace to " << traceFilename << "..." << endl;
+        if (Trace::SaveToFileJSON(traceFilename) != 0)
+        {
+            return 1;
+        }
+    }
  
     // clean up
     scene.ClearShapes();
 
-    auto end = chrono::high_resolution_clock::now();
-    double elapsed = chrono::duration_cast<chrono::milliseconds>(end - start).count() / (double)1000;
     cout << "Render Complete" << endl;
     cout << "Total time: " << elapsed << "s" << endl;
 
     return 0;
 }
 
-void getOutputFilename(int argc, char* argv[], string& outputFilename)
+void getOutputFilename(vector<string>& args, string& outputFilename)
 {
-    if (argc == 3)
+    if (args.size() == 2)
     {
-        outputFilename = argv[2];
+        outputFilename = args[1];
     }
     else
     {
-        outputFilename = argv[1];
+        outputFilename = args[0];
     }
 
     // remove extension from output file name and add .ppm
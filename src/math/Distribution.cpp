@@ -0,0 +1,81 @@
+#include "Distribution.h"
+
+#include <algorithm>
+
+Distribution1D::Distribution1D()
+{
+    integral = 0;
+}
+
+Distribution1D::Distribution1D(const Float* values, int count)
+{
+    func.assign(values, values + count);
+    cdf.resize(count + 1);
+
+    cdf[0] = 0;
+    for (int i = 0; i < count; i++)
+    {
+        cdf[i + 1] = cdf[i] + func[i] / count;
+    }
+    integral = cdf[count];
+
+    // fall back to a uniform distribution if everything is zero
+    for (int i = 1; i <= count; i++)
+    {
+        cdf[i] = integral > 0 ? cdf[i] / integral : (Float) i / count;
+    }
+}
+
+// binary search for the last cdf entry <= u
+int Distribution1D::FindPiece(Float u) const
+{
+    int offset = upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin() - 1;
+    return max(0, min(offset, (int) func.size() - 1));
+}
+
+Float Distribution1D::Sample(Float u, Float& pdf, int& offset) const
+{
+    offset = FindPiece(u);
+
+    // position within the piece
+    Float du = u - cdf[offset];
+    Float width = cdf[offset + 1] - cdf[offset];
+    if (width > 0)
+    {
+        du /= width;
+    }
+
+    pdf = integral > 0 ? func[offset] / integral : 1;
+    return (offset + du) / func.size();
+}
+
+int Distribution1D::SampleDiscrete(Float u, Float& probability) const
+{
+    int offset = FindPiece(u);
+    probability = integral > 0 ? func[offset] / (integral * func.size()) : (Float) 1 / func.size();
+    return offset;
+}
+
+Distribution2D::Distribution2D()
+{
+}
+
+Distribution2D::Distribution2D(const Float* values, int width, int height)
+{
+    vector<Float> rowIntegrals(height);
+    for (int y = 0; y < height; y++)
+    {
+        conditional.push_back(Distribution1D(values + y * width, width));
+        rowIntegrals[y] = conditional.back().GetIntegral();
+    }
+    marginal = Distribution1D(rowIntegrals.data(), height);
+}
+
+void Distribution2D::Sample(Float u1, Float u2, Float& u, Float& v, Float& pdf) const
+{
+    Float pdfU, pdfV;
+    int row, column;
+    v = marginal.Sample(u2, pdfV, row);
+    u = conditional[row].Sample(u1, pdfU, column);
+    pdf = pdfU * pdfV;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef DISTRIBUTION
+#define DISTRIBUTION
+
+#include "Vector3.h"
+
+#include <vector>
+
+using namespace std;
+
+// piecewise constant distribution over [0, 1] built from a list of (non negative) function values,
+// sampled by inverting its cdf
+class Distribution1D
+{
+    public:
+        Distribution1D();
+        Distribution1D(const Float* values, int count);
+
+        Float Sample(Float u, Float& pdf, int& offset) const;   // returns a point in [0, 1]
+        int SampleDiscrete(Float u, Float& probability) const;  // returns the index of a piece
+        Float GetIntegral() const { return integral; }
+        int GetCount() const { return func.size(); }
+        Float GetValue(int index) const { return func[index]; }
+
+    private:
+        vector<Float> func;
+        vector<Float> cdf;      // one longer than func, cdf[0] = 0 and cdf[n] = 1
+        Float integral;
+
+        int FindPiece(Float u) const;
+};
+
+// piecewise constant distribution over [0, 1]^2, the rows are picked by their marginal distribution
+// and then a point in the row by that row's conditional distribution
+class Distribution2D
+{
+    public:
+        Distribution2D();
+        Distribution2D(const Float* values, int width, int height);    // values stored row by row
+
+        void Sample(Float u1, Float u2, Float& u, Float& v, Float& pdf) const;
+
+    private:
+        vector<Distribution1D> conditional;
+        Distribution1D marginal;
+};
+
+#endif
\ No newline at end of file
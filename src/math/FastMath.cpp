@@ -0,0 +1,94 @@
+#include "FastMath.h"
+
+#include <chrono>
+#include <random>
+
+GammaTable::GammaTable()
+{
+    Build(1);
+}
+
+void GammaTable::Build(Float gamma)
+{
+    this->gamma = gamma;
+    invGamma = 1.0 / gamma;
+    values.resize(SIZE + 1);
+    for (int i = 0; i <= SIZE; i++)
+    {
+        values[i] = pow((double) i / SIZE, 2 * invGamma);
+    }
+}
+
+// times func over every input, returning nanoseconds per call. the results get summed into sink so the
+// calls can't be optimized out
+template <typename F>
+static double TimeKernel(const vector<Float>& inputs, F func, double& sink)
+{
+    const int REPEATS = 20;
+    auto start = chrono::high_resolution_clock::now();
+    double sum = 0;
+    for (int r = 0; r < REPEATS; r++)
+    {
+        for (int i = 0; i < inputs.size(); i++)
+        {
+            sum += func(inputs[i]);
+        }
+    }
+    auto end = chrono::high_resolution_clock::now();
+    sink += sum;
+    return chrono::duration_cast<chrono::nanoseconds>(end - start).count() / (double) (REPEATS * inputs.size());
+}
+
+template <typename E, typename F>
+static void BenchmarkKernel(const string& name, const vector<Float>& inputs, E exact, F fast, double& sink)
+{
+    double maxAbsError = 0;
+    double maxRelError = 0;
+    for (int i = 0; i < inputs.size(); i++)
+    {
+        double a = exact(inputs[i]);
+        double b = fast(inputs[i]);
+        maxAbsError = max(maxAbsError, fabs(a - b));
+        // relative error only means much away from zero, tiny results underflow in both
+        if (fabs(a) > 1e-6)
+        {
+            maxRelError = max(maxRelError, fabs(a - b) / fabs(a));
+        }
+    }
+
+    double exactTime = TimeKernel(inputs, exact, sink);
+    double fastTime = TimeKernel(inputs, fast, sink);
+    cout << "  " << name << ": exact " << exactTime << " ns, fast " << fastTime << " ns, speedup "
+         << exactTime / fastTime << "x, max abs error " << maxAbsError << ", max rel error " << maxRelError << endl;
+}
+
+int RunMathBenchmark()
+{
+    const int NUM_INPUTS = 1 << 20;
+    mt19937 rng(1);
+    uniform_real_distribution<Float> unit(0, 1);
+    vector<Float> inputs(NUM_INPUTS);
+    for (int i = 0; i < NUM_INPUTS; i++)
+    {
+        inputs[i] = unit(rng);
+    }
+
+    double sink = 0;
+    GammaTable gamma;
+    gamma.Build(2.2);
+
+#ifdef FAST_MATH
+    cout << "Math kernels (shading uses the fast versions):" << endl;
+#else
+    cout << "Math kernels (shading uses the exact versions, build with make fast for the others):" << endl;
+#endif
+    BenchmarkKernel("specular pow, n = 20", inputs, [](Float x) { return ExactSpecularPow(x, 20); }, [](Float x) { return FastSpecularPow(x, 20); }, sink);
+    BenchmarkKernel("specular pow, n = 256", inputs, [](Float x) { return ExactSpecularPow(x, 256); }, [](Float x) { return FastSpecularPow(x, 256); }, sink);
+    BenchmarkKernel("square", inputs, [](Float x) { return ExactSquare(x); }, [](Float x) { return FastSquare(x); }, sink);
+    BenchmarkKernel("schlick weight", inputs, [](Float x) { return ExactSchlickWeight(x); }, [](Float x) { return FastSchlickWeight(x); }, sink);
+    BenchmarkKernel("gamma 2.2", inputs, [&gamma](Float x) { return gamma.Exact(x); }, [&gamma](Float x) { return gamma.Fast(x); }, sink);
+
+    // print the sink so the timed loops can't be thrown away
+    cout << "  (checksum " << sink << ")" << endl;
+    return 0;
+}
\ No newline at end of file
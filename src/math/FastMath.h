@@ -0,0 +1,119 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include "Vector3.h"
+
+#include <vector>
+
+using namespace std;
+
+// Cheaper versions of the pow calls in the shading code. Each kernel has an exact version that just
+// calls pow and a fast one, and building with FAST_MATH (make fast) switches the shading over to the
+// fast ones. The fast versions are only used where their error is bounded:
+//  - specular exponents that are whole numbers use exponentiation by squaring, which is within a few
+//    ulps of pow, anything else still calls pow. only for doubles though, single precision pow is
+//    already quicker than the squaring loop
+//  - the fresnel square and fifth power are just multiplies
+//  - gamma correction lerps a table indexed by sqrt(x), within 1e-4 of pow on [0, 1] which is well
+//    under one 8 bit step, values outside [0, 1] still call pow
+
+inline Float ExactSpecularPow(Float x, Float n)
+{
+    return pow(x, n);
+}
+
+inline Float FastSpecularPow(Float x, Float n)
+{
+    int e = (int) n;
+    if (e != n || e < 0 || e > 65536)
+    {
+        return pow(x, n);
+    }
+
+    Float result = 1;
+    while (e > 0)
+    {
+        if (e & 1)
+        {
+            result *= x;
+        }
+        x *= x;
+        e >>= 1;
+    }
+    return result;
+}
+
+inline double ExactSquare(Float x)
+{
+    return pow(x, 2);
+}
+
+inline Float FastSquare(Float x)
+{
+    return x * x;
+}
+
+// (1 - cos)^5 for schlick's fresnel approximation
+inline double ExactSchlickWeight(Float cosTheta)
+{
+    return pow(1 - cosTheta, 5);
+}
+
+inline Float FastSchlickWeight(Float cosTheta)
+{
+    Float m = 1 - cosTheta;
+    Float m2 = m * m;
+    return m2 * m2 * m;
+}
+
+// x^(1 / gamma) looked up from a table, for gamma correcting the final pixels
+class GammaTable
+{
+    public:
+        static const int SIZE = 1024;
+
+        GammaTable();
+        void Build(Float gamma);
+        Float GetGamma() const { return gamma; }
+
+        double Exact(Float x) const { return pow(x, invGamma); }
+        Float Fast(Float x) const
+        {
+            if (!(x >= 0 && x <= 1))
+            {
+                return pow(x, invGamma);
+            }
+
+            // x^(1 / gamma) is steep near 0, but (sqrt x)^(2 / gamma) is close enough to a line for a lerp
+            Float s = sqrt(x) * SIZE;
+            int i = min((int) s, SIZE - 1);
+            Float t = s - i;
+            return values[i] + (values[i + 1] - values[i]) * t;
+        }
+
+    private:
+        Float gamma;
+        double invGamma;
+        vector<Float> values;   // SIZE + 1 entries, (i / SIZE)^(2 / gamma)
+};
+
+#if defined(FAST_MATH) && defined(USE_DOUBLE)
+inline Float SpecularPow(Float x, Float n) { return FastSpecularPow(x, n); }
+#else
+inline Float SpecularPow(Float x, Float n) { return ExactSpecularPow(x, n); }
+#endif
+
+#ifdef FAST_MATH
+inline Float Square(Float x) { return FastSquare(x); }
+inline Float SchlickWeight(Float cosTheta) { return FastSchlickWeight(cosTheta); }
+inline Float GammaCorrectChannel(const GammaTable& table, Float x) { return table.Fast(x); }
+#else
+inline double Square(Float x) { return ExactSquare(x); }
+inline double SchlickWeight(Float cosTheta) { return ExactSchlickWeight(cosTheta); }
+inline double GammaCorrectChannel(const GammaTable& table, Float x) { return table.Exact(x); }
+#endif
+
+// runs each kernel's exact and fast versions over the same inputs, printing their largest error and speedup
+int RunMathBenchmark();
+
+#endif
\ No newline at end of file
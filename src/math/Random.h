@@ -0,0 +1,47 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include "Vector3.h"
+
+#include <cstdint>
+
+using namespace std;
+
+// Random numbers for sampling, from a splitmix64 stream kept per thread. Rather than one stream for the
+// whole render, the camera reseeds it for every pixel (or wavefront batch), so what a pixel gets only
+// depends on where it is and not on which thread rendered it or what came before. That keeps images the
+// same for any number of threads, and lets a render resumed from a checkpoint finish exactly as an
+// uninterrupted one would. It's also much cheaper than rand, which takes a lock on every call.
+inline uint64_t& RandomState()
+{
+    static thread_local uint64_t state = 0;
+    return state;
+}
+
+inline uint64_t RandomBits()
+{
+    uint64_t z = (RandomState() += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// seeds this thread's stream, neighbouring seeds still give unrelated streams
+inline void SeedRandom(uint64_t seed)
+{
+    RandomState() = seed * 0xD1B54A32D192ED03ull;
+}
+
+// uniform in [0, 1), 24 bits so it can't round up to 1 as a float
+inline Float RandomFloat()
+{
+    return (Float) ((RandomBits() >> 40) * (1.0 / 16777216.0));
+}
+
+// uniform in [0, n)
+inline int RandomInt(int n)
+{
+    return (int) ((RandomBits() >> 32) * n >> 32);
+}
+
+#endif
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Vector3.h"
+#include "Random.h"
 
 using namespace std;
 
@@ -101,15 +102,15 @@ Vector3 Vector3::ProjectOnPlane(Vector3 v, Vector3 normal)
 
 Vector3 Vector3::RandOnUnitSphere()
 {
-    Float x = (rand() / ((Float) RAND_MAX)) * 2 - 1;
-    Float y = (rand() / ((Float) RAND_MAX)) * 2 - 1;
-    Float z = (rand() / ((Float) RAND_MAX)) * 2 - 1;
+    Float x = RandomFloat() * 2 - 1;
+    Float y = RandomFloat() * 2 - 1;
+    Float z = RandomFloat() * 2 - 1;
 
     while (x * x + y * y + z * z > 1)
     {
-        x = (rand() / ((Float) RAND_MAX)) * 2 - 1;
-        y = (rand() / ((Float) RAND_MAX)) * 2 - 1;
-        z = (rand() / ((Float) RAND_MAX)) * 2 - 1;
+        x = RandomFloat() * 2 - 1;
+        y = RandomFloat() * 2 - 1;
+        z = RandomFloat() * 2 - 1;
     }
 
     return Vector3(x, y, z).normalized();
@@ -1,4 +1,5 @@
 #include "Cylinder.h"
+#include "core/RenderStats.h"
 
 Cylinder::Cylinder()
 {
@@ -54,6 +55,12 @@ void Cylinder::CalculateLocalBasis()
 // inside the cylinder, outside the cylinder, above/below the caps...
 bool Cylinder::Intersect(Ray ray, RayHit& hitInfo)
 {
+    CountRender(COUNT_CYLINDER_TESTS);
+
+    // no surface derivatives for cylinders, clear any left over from a hit on another shape
+    hitInfo.dpdu = hitInfo.dpdv = Vector3::zero;
+    hitInfo.dndu = hitInfo.dndv = Vector3::zero;
+
     // first transform ray to local space
     Vector3 relPos = ray.origin - position;
     Vector3 relDir = ray.direction;
@@ -1,4 +1,5 @@
 #include "Sphere.h"
+#include "core/RenderStats.h"
 
 Sphere::Sphere()
 {
@@ -16,6 +17,8 @@ Sphere::Sphere(Vector3 position, int matInd, Float radius)
 
 bool Sphere::Intersect(Ray ray, RayHit& hitInfo)
 {
+    CountRender(COUNT_SPHERE_TESTS);
+
     Vector3 offset = position - ray.origin;
     Float b = offset.dot(ray.direction); // no need to calculate a, as it is 1
     Float c = offset.dot(offset) - radius * radius;
@@ -77,4 +80,18 @@ void Sphere::SetUVInfo(RayHit& hitInfo)
     
     hitInfo.tangent = tangent.normalized();
     hitInfo.bitangent = bitangent.normalized();
+
+    // partial derivatives for texture filtering, u = 1 - (phi + pi) / 2pi and v = theta / pi
+    Float rho = sqrt(relPos.x * relPos.x + relPos.z * relPos.z);
+    hitInfo.dpdu = 2 * M_PI * Vector3(relPos.z, 0, -relPos.x);
+    if (rho > 0)
+    {
+        hitInfo.dpdv = M_PI * Vector3(relPos.y * relPos.x / rho, -rho, relPos.y * relPos.z / rho);
+    }
+    else
+    {
+        hitInfo.dpdv = Vector3::zero;
+    }
+    hitInfo.dndu = hitInfo.dpdu / radius;
+    hitInfo.dndv = hitInfo.dpdv / radius;
 }
\ No newline at end of file
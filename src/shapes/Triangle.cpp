@@ -1,4 +1,5 @@
 #include "Triangle.h"
+#include "core/RenderStats.h"
 
 Triangle::Triangle()
 {
@@ -145,6 +146,8 @@ bool Triangle::GetBarycentricCoords(Vector3 point, Float& a, Float& b, Float& g)
 
 bool Triangle::Intersect(Ray ray, RayHit& hitInfo)
 {
+    CountRender(COUNT_TRIANGLE_TESTS);
+
     Vector3 point;
     if (!PlaneIntersection(ray, point))
     {
@@ -186,6 +189,10 @@ WorldBounds Triangle::GetWorldBounds()
 
 void Triangle::SetUVInfo(RayHit& hitInfo, Vector3 barys)
 {
+    // hitInfo gets reused between shapes, so clear the derivatives in case they're not all set below
+    hitInfo.dpdu = hitInfo.dpdv = Vector3::zero;
+    hitInfo.dndu = hitInfo.dndv = Vector3::zero;
+
     if (hasUVs)
     {
         hitInfo.uv = barys.x * uv0 + barys.y * uv1 + barys.z * uv2;
@@ -209,6 +216,17 @@ void Triangle::SetUVInfo(RayHit& hitInfo, Vector3 barys)
 
         hitInfo.tangent = tangent.normalized();
         hitInfo.bitangent = bitangent.normalized();
+
+        // tangent and bitangent are dp/du and dp/dv before normalizing
+        hitInfo.dpdu = tangent;
+        hitInfo.dpdv = bitangent;
+        if (hasNormals)
+        {
+            Vector3 dn1 = vn1 - vn0;
+            Vector3 dn2 = vn2 - vn0;
+            hitInfo.dndu = invDet * (dv2 * dn1 - dv1 * dn2);
+            hitInfo.dndv = invDet * (-du2 * dn1 + du1 * dn2);
+        }
     }
     else
     {
@@ -218,6 +236,14 @@ void Triangle::SetUVInfo(RayHit& hitInfo, Vector3 barys)
         // default for tangent along e1
         hitInfo.tangent = e1.normalized();
         hitInfo.bitangent = normal.cross(hitInfo.tangent).normalized();
+
+        hitInfo.dpdu = e1;
+        hitInfo.dpdv = e2;
+        if (hasNormals)
+        {
+            hitInfo.dndu = vn1 - vn0;
+            hitInfo.dndv = vn2 - vn0;
+        }
     }
 
 